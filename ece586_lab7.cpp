@@ -7,423 +7,4871 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <set>
+#include <unordered_set>
+#include <memory>
+#include <map>
+#include <unordered_map>
+#include <deque>
+#include <sstream>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <charconv>
+#include <chrono>
+#include <random>
+#include <new>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <climits>
+#include <limits>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+// x86 builds compile the SIMD tag compares with target attributes and pick one at run time
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MEMSIM_X86_SIMD
+#include <immintrin.h>
+#endif
+// Library interface (cacheSim) and the types it shares with the simulator
+#include "memsim.h"
 
 using namespace std;
 
+// Everything but main() is in the memsim namespace, so library builds can be
+// linked into programs without name clashes
+namespace memsim {
+
 // Display string for unknown data values. Constant string instead of #define
 // so that string comparisons are viable
 const string UNKOWN_STR = "xxx";
 
-/* 
-    Memory Operation structure that the simulator will execute.
-    Parsed in from the input file.
+// Display string of a memory operation result
+inline const char* result_string(uint8_t result){
+    return (result == RESULT_HIT) ? "hit" : (result == RESULT_MISS) ? "miss" : UNKOWN_STR.c_str();
+}
+
+// Number of memory operations read from the trace and simulated at a time
+const int TRACE_BATCH_SIZE = 4096;
+
+// Next use of a main memory block that is never referenced again
+const long long NEVER_USED = LLONG_MAX;
+
+/* 
+    Memory Operation structure that the simulator will execute.
+    Parsed in from the input file.
+
+Members:
+    Character op_type: Memory operation type. 'R' = Read and 'W' = Write
+    uint64_t mem_address: The numeric main memory address to either read or write
+    uint64_t mem_block: The numeric main memory block
+    uint64_t tag: The packed tag bits of the memory address
+    Integer cache_set: The cache set the main memory block is associated with
+    Integer cache_block_start: The starting block cache of the cache set
+    Long next_use: The index of the next operation on the same main memory block
+        (NEVER_USED if none). Only filled in for the OPT replacement policy
+    opResult result: The result of the memory operation, hit or miss (see result_string)
+*/
+struct memOp{
+    char op_type;
+    uint64_t mem_address;
+    uint64_t mem_block;
+    uint64_t tag;
+    int  cache_set;
+    int  cache_block_start;
+    long long next_use;
+    opResult result;
+};
+
+/*
+    Per cache set counters, filled in by the simulator kernel when requested
+
+Members:
+    Vectors accesses, misses, evictions, dirty_evictions: The number of memory
+        operations, misses, valid blocks replaced and dirty blocks replaced of each set
+*/
+struct setCounters{
+    vector<long long> accesses;
+    vector<long long> misses;
+    vector<long long> evictions;
+    vector<long long> dirty_evictions;
+
+    // Allocates zeroed counters for the given number of cache sets
+    void init(int num_sets){
+        accesses.assign(num_sets, 0);
+        misses.assign(num_sets, 0);
+        evictions.assign(num_sets, 0);
+        dirty_evictions.assign(num_sets, 0);
+    }
+};
+
+// Size in bytes of a cache line of the machine running the simulator
+const int HOST_LINE_BYTES = 64;
+
+// Allocator of host cache line aligned arrays, so that the tags or metadata of a
+// simulated cache set start on a line boundary (8 ways of tags fill exactly one line)
+template<class T>
+struct lineAllocator{
+    typedef T value_type;
+    lineAllocator() = default;
+    template<class U> lineAllocator(const lineAllocator<U> &){}
+    T* allocate(size_t num_values){ return static_cast<T*>(::operator new(num_values * sizeof(T), align_val_t(HOST_LINE_BYTES))); }
+    void deallocate(T* values, size_t){ ::operator delete(values, align_val_t(HOST_LINE_BYTES)); }
+    template<class U> bool operator==(const lineAllocator<U> &) const { return true; }
+    template<class U> bool operator!=(const lineAllocator<U> &) const { return false; }
+};
+// Heap array whose first element is host cache line aligned
+template<class T>
+using lineVector = vector<T, lineAllocator<T>>;
+
+/**********************************************************************************
+Function name:    match_tags_scalar(const uint64_t* way_tags, int num_ways, uint64_t tag)
+Input parameters: const uint64_t* way_tags: The tags of up to 64 ways of a cache set
+                  Integer num_ways: The number of ways to compare (at most 64)
+                  uint64_t tag: The packed tag to search for
+Return value:     uint64_t: Bitmask of the ways whose tag matches (bit 0 = way_tags[0])
+Purpose:          Compares a tag against the ways one at a time. The SIMD versions
+                  below return the same bitmask
+**********************************************************************************/
+inline uint64_t match_tags_scalar(const uint64_t* way_tags, int num_ways, uint64_t tag){
+    uint64_t match_bits = 0; // Bitmask of the ways whose tag matches
+    for(int way=0; way < num_ways; way++)
+        match_bits |= (uint64_t)(way_tags[way] == tag) << way;
+    return match_bits;
+}
+
+#ifdef MEMSIM_X86_SIMD
+// Compares 4 tags per instruction, on CPUs with AVX2
+__attribute__((target("avx2")))
+inline uint64_t match_tags_avx2(const uint64_t* way_tags, int num_ways, uint64_t tag){
+    uint64_t match_bits = 0; // Bitmask of the ways whose tag matches
+    int way = 0; // Current way being compared
+    __m256i tag_vec = _mm256_set1_epi64x((long long)tag);
+    for(; way + 4 <= num_ways; way += 4){
+        __m256i tags_vec = _mm256_loadu_si256((const __m256i*)(way_tags + way));
+        match_bits |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(tags_vec, tag_vec))) << way;
+    }
+    for(; way < num_ways; way++)
+        match_bits |= (uint64_t)(way_tags[way] == tag) << way;
+    return match_bits;
+}
+
+// Compares 2 tags per instruction, on CPUs with SSE4.1
+__attribute__((target("sse4.1")))
+inline uint64_t match_tags_sse41(const uint64_t* way_tags, int num_ways, uint64_t tag){
+    uint64_t match_bits = 0; // Bitmask of the ways whose tag matches
+    int way = 0; // Current way being compared
+    __m128i tag_vec = _mm_set1_epi64x((long long)tag);
+    for(; way + 2 <= num_ways; way += 2){
+        __m128i tags_vec = _mm_loadu_si128((const __m128i*)(way_tags + way));
+        match_bits |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(tags_vec, tag_vec))) << way;
+    }
+    for(; way < num_ways; way++)
+        match_bits |= (uint64_t)(way_tags[way] == tag) << way;
+    return match_bits;
+}
+#endif
+
+// Tag compare function, chosen once for the CPU running the simulator
+typedef uint64_t (*tagMatcher)(const uint64_t* way_tags, int num_ways, uint64_t tag);
+
+// Returns the widest tag compare the CPU supports
+inline tagMatcher select_tag_matcher(){
+#ifdef MEMSIM_X86_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return match_tags_avx2;
+    if(__builtin_cpu_supports("sse4.1"))
+        return match_tags_sse41;
+#endif
+    return match_tags_scalar;
+}
+const tagMatcher match_tags = select_tag_matcher();
+
+// Fewest ways for which the call to the SIMD tag compare beats the inlined scalar loop
+const int SIMD_MIN_WAYS = 8;
+
+/*
+    Cache memory structure for use in keeping track of cache status.
+    Stored as a structure-of-arrays: the tags of a cache set sit next to each
+    other so that all ways of the set can be compared at once, and the valid
+    and dirty bits of a set are packed into bitmasks (one bit per way).
+    Blocks hold no data or block number, the tag and cache set give the main
+    memory block back (see block_of). Every array is heap allocated and
+    host cache line aligned, so large caches cost a few bytes per block.
+
+Members:
+    Integer num_sets: The number of cache sets
+    Integer assoc_deg: The degree of association (ways per cache set)
+    Integer num_mask_words: The number of 64-bit mask words per cache set
+    Vector tags: The packed tag of each cache block's data, grouped by cache set
+    Vector valid_bits: Bitmask per cache set of the ways containing valid data
+    Vector dirty_bits: Bitmask per cache set of the ways containing dirty data
+    Vector last_used: Simulator clock value of each block's most recent access (LRU)
+    Vector inserted: Simulator clock value of when each block was filled (FIFO)
+    Vector next_use: Simulator clock value of the next use of each block's data (OPT)
+    Vector opt_heap: Per cache set, the valid ways as a max-heap on next_use (OPT)
+    Vector opt_heap_pos: The position of each block in its cache set's heap (OPT)
+    Vector opt_heap_size: The number of ways in each cache set's heap (OPT)
+    Vector plru_bits: The pseudo-LRU tree bits of each cache set (tree-PLRU)
+    Vector rrpv: The re-reference prediction value of each block (SRRIP/BRRIP)
+    Vector rng_state: The random number generator state of each cache set (random/BRRIP)
+    Vector use_count: The number of accesses to each block since its fill (LFU)
+    Only the metadata of the cache's replacement policy is allocated (see init_cache)
+*/
+struct cacheMemory{
+    int num_sets;
+    int assoc_deg;
+    int num_mask_words;
+    lineVector<uint64_t> tags;
+    lineVector<uint64_t> valid_bits;
+    lineVector<uint64_t> dirty_bits;
+    lineVector<long long> last_used;
+    lineVector<long long> inserted;
+    lineVector<long long> next_use;
+    lineVector<int> opt_heap;
+    lineVector<int> opt_heap_pos;
+    lineVector<int> opt_heap_size;
+    lineVector<uint64_t> plru_bits;
+    lineVector<uint8_t> rrpv;
+    lineVector<uint64_t> rng_state;
+    lineVector<uint32_t> use_count;
+
+    // Returns the index of the mask word holding the given way of the given cache set
+    int mask_word(int cache_set, int way) const { return cache_set * num_mask_words + (way >> 6); }
+    // Returns the bit within its mask word for the given way
+    static uint64_t mask_bit(int way) { return 1ULL << (way & 63); }
+
+    // Valid and dirty bit accessors for a given way of a given cache set
+    bool is_valid(int cache_set, int way) const { return valid_bits[mask_word(cache_set, way)] & mask_bit(way); }
+    bool is_dirty(int cache_set, int way) const { return dirty_bits[mask_word(cache_set, way)] & mask_bit(way); }
+    void set_valid(int cache_set, int way){ valid_bits[mask_word(cache_set, way)] |= mask_bit(way); }
+    void set_dirty(int cache_set, int way, bool dirty){
+        if(dirty)
+            dirty_bits[mask_word(cache_set, way)] |= mask_bit(way);
+        else
+            dirty_bits[mask_word(cache_set, way)] &= ~mask_bit(way);
+    }
+
+    // Main memory block number of the data in a valid way of a cache set (see parse_tag)
+    uint64_t block_of(int cache_set, int way) const { return tags[(size_t)cache_set * assoc_deg + way] * num_sets + cache_set; }
+
+    /**********************************************************************************
+    Function name:    find_tag<ASSOC>(int cache_set, uint64_t tag)
+    Input parameters: ASSOC: The associativity compiled in, or 0 to use assoc_deg
+                      Integer cache_set: The cache set to search
+                      uint64_t tag: The packed tag to search for
+    Return value:     Integer: The way holding the tag, or -1 if the tag is not cached
+    Purpose:          Compares the tag against every way of the cache set. Ways are
+                      compared 4 (AVX2) or 2 (SSE4.1) at a time into a match bitmask
+                      which is then masked with the set's valid bits. Builds without
+                      -mavx2/-msse4.1 call the compare picked for the CPU at start up
+                      (see select_tag_matcher) for sets of SIMD_MIN_WAYS or more. With
+                      ASSOC compiled in the loops have constant bounds and are unrolled
+    **********************************************************************************/
+    template<int ASSOC = 0>
+    int find_tag(int cache_set, uint64_t tag) const {
+        const int assoc = ASSOC ? ASSOC : assoc_deg; // Ways per cache set
+        const int mask_words = ASSOC ? (ASSOC + 63) / 64 : num_mask_words; // Mask words per cache set
+        const uint64_t* set_tags = &tags[(size_t)cache_set * assoc]; // Tags of the cache set
+        // Iterate through the cache set 64 ways (one mask word) at a time
+        for(int word=0; word < mask_words; word++){
+            int way_base = word * 64; // First way covered by this mask word
+            int way_end = min(assoc, way_base + 64); // One past the last way of this mask word
+            uint64_t match_bits = 0; // Bitmask of the ways whose tag matches
+            int way = way_base; // Current way being compared
+#if defined(__AVX2__)
+            // Compare 4 tags per instruction
+            __m256i tag_vec = _mm256_set1_epi64x((long long)tag);
+            for(; way + 4 <= way_end; way += 4){
+                __m256i way_tags = _mm256_loadu_si256((const __m256i*)(set_tags + way));
+                uint64_t lanes = (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(way_tags, tag_vec)));
+                match_bits |= lanes << (way - way_base);
+            }
+#elif defined(__SSE4_1__)
+            // Compare 2 tags per instruction
+            __m128i tag_vec = _mm_set1_epi64x((long long)tag);
+            for(; way + 2 <= way_end; way += 2){
+                __m128i way_tags = _mm_loadu_si128((const __m128i*)(set_tags + way));
+                uint64_t lanes = (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(way_tags, tag_vec)));
+                match_bits |= lanes << (way - way_base);
+            }
+#else
+            if(way_end - way_base >= SIMD_MIN_WAYS){
+                match_bits = match_tags(set_tags + way_base, way_end - way_base, tag);
+                way = way_end;
+            }
+#endif
+            // Scalar compare of any remaining ways (all of them without SIMD support)
+            for(; way < way_end; way++){
+                match_bits |= (uint64_t)(set_tags[way] == tag) << (way - way_base);
+            }
+            // Only ways holding valid data can match
+            match_bits &= valid_bits[(size_t)cache_set * mask_words + word];
+            if(match_bits)
+                return way_base + __builtin_ctzll(match_bits);
+        }
+        return -1; // Tag not found in the cache set
+    }
+
+    /**********************************************************************************
+    Function name:    find_empty<ASSOC>(int cache_set)
+    Input parameters: ASSOC: The associativity compiled in, or 0 to use assoc_deg
+                      Integer cache_set: The cache set to search
+    Return value:     Integer: The first way not yet written to, or -1 if the set is full
+    Purpose:          Finds an empty cache block in the cache set using its valid bits
+    **********************************************************************************/
+    template<int ASSOC = 0>
+    int find_empty(int cache_set) const {
+        const int assoc = ASSOC ? ASSOC : assoc_deg; // Ways per cache set
+        const int mask_words = ASSOC ? (ASSOC + 63) / 64 : num_mask_words; // Mask words per cache set
+        // Iterate through the cache set's mask words
+        for(int word=0; word < mask_words; word++){
+            uint64_t empty_bits = ~valid_bits[(size_t)cache_set * mask_words + word];
+            // If an invalid way exists in this word and it is a real way of the set
+            if(empty_bits){
+                int way = word * 64 + __builtin_ctzll(empty_bits);
+                return (way < assoc) ? way : -1;
+            }
+        }
+        return -1; // Every way of the cache set is valid
+    }
+
+    /**********************************************************************************
+    Function name:    opt_push(int cache_set, int way)
+    Input parameters: Integer cache_set: The cache set of the block
+                      Integer way: The newly filled way
+    Return value:     Void - Returns nothing
+    Purpose:          Adds a way to its cache set's OPT heap, a max-heap of the set's
+                      ways ordered by the next use of their data
+    **********************************************************************************/
+    void opt_push(int cache_set, int way){
+        int base = cache_set * assoc_deg; // First heap slot (and block) of the cache set
+        int slot = opt_heap_size[cache_set]++; // Heap slot the way is added at
+        opt_heap[base + slot] = way;
+        opt_heap_pos[base + way] = slot;
+        opt_sift(cache_set, slot);
+    }
+
+    /**********************************************************************************
+    Function name:    opt_update(int cache_set, int way)
+    Input parameters: Integer cache_set: The cache set of the block
+                      Integer way: The way whose next use changed
+    Return value:     Void - Returns nothing
+    Purpose:          Restores the OPT heap order after a way's next use changed
+    **********************************************************************************/
+    void opt_update(int cache_set, int way){
+        opt_sift(cache_set, opt_heap_pos[cache_set * assoc_deg + way]);
+    }
+
+    // Returns the way of the cache set whose data is used furthest in the future
+    int opt_victim(int cache_set) const { return opt_heap[cache_set * assoc_deg]; }
+
+    // Moves a heap slot up or down until its set's OPT heap is ordered again, O(log assoc_deg)
+    void opt_sift(int cache_set, int slot){
+        int base = cache_set * assoc_deg; // First heap slot (and block) of the cache set
+        int size = opt_heap_size[cache_set]; // Number of ways in the heap
+        int way = opt_heap[base + slot]; // Way being moved
+        long long key = next_use[base + way]; // Next use of the way's data
+        // Move up while the parent is used sooner
+        while(slot > 0 && next_use[base + opt_heap[base + (slot - 1) / 2]] < key){
+            opt_heap[base + slot] = opt_heap[base + (slot - 1) / 2];
+            opt_heap_pos[base + opt_heap[base + slot]] = slot;
+            slot = (slot - 1) / 2;
+        }
+        // Move down while a child is used later
+        while(2 * slot + 1 < size){
+            int child = 2 * slot + 1; // Child used furthest in the future
+            if(child + 1 < size && next_use[base + opt_heap[base + child + 1]] > next_use[base + opt_heap[base + child]])
+                child++;
+            if(next_use[base + opt_heap[base + child]] <= key)
+                break;
+            opt_heap[base + slot] = opt_heap[base + child];
+            opt_heap_pos[base + opt_heap[base + slot]] = slot;
+            slot = child;
+        }
+        opt_heap[base + slot] = way;
+        opt_heap_pos[base + way] = slot;
+    }
+};
+
+// Returns the way with the smallest (oldest) clock value of a cache set's timestamps.
+// ASSOC is the associativity compiled in, or 0 to use assoc_deg
+template<int ASSOC>
+inline int oldest_way(const long long set_times[], int assoc_deg){
+    const int assoc = ASSOC ? ASSOC : assoc_deg; // Ways per cache set
+    int way = 0; // Oldest way so far
+    for(int cache_block_offset=1; cache_block_offset < assoc; cache_block_offset++){
+        // If this block is older, make it the victim
+        if(set_times[cache_block_offset] < set_times[way])
+            way = cache_block_offset;
+    }
+    return way;
+}
+
+// Seeds and advances the xorshift64* generators used by the random and BRRIP policies.
+// Each cache set has its own generator so results do not depend on the order sets are simulated in
+inline uint64_t seed_random(int cache_set){ return 0x9E3779B97F4A7C15ULL * (uint64_t)(cache_set + 1); }
+inline uint64_t next_random(uint64_t &state){
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+    Replacement Policies
+
+Each replacement policy is a structure of static functions that the simulator
+kernel (MemorySim::run_ops) takes as a template parameter, so the policy is
+chosen once per batch and its code is inlined into the per-operation loop.
+The hooks also take the kernel's ASSOC (the associativity compiled in, or 0 to
+use cache.assoc_deg), so their loops over the ways have constant bounds too.
+Every policy provides:
+    init(cache): Allocates the policy's metadata in the cache memory
+    on_hit<ASSOC>(cache, cache_set, way, block, op, now): Updates the metadata on a hit
+    on_fill<ASSOC>(cache, cache_set, way, block, op, now, fill_empty): Updates the
+        metadata when a block is filled into an empty or an evicted way
+    victim<ASSOC>(cache, cache_set, block_start): Returns the way to evict from a full set
+Policies are looked up by their replace_policy letter with dispatch_policy().
+*/
+
+// Least recently used: evicts the block with the oldest access time
+struct lruPolicy{
+    static void init(cacheMemory &cache){ cache.last_used.assign(cache.num_sets * cache.assoc_deg, -1); }
+    template<int ASSOC> static void on_hit(cacheMemory &cache, int, int, int block, const memOp &, long long now){ cache.last_used[block] = now; }
+    template<int ASSOC> static void on_fill(cacheMemory &cache, int, int, int block, const memOp &, long long now, bool){ cache.last_used[block] = now; }
+    template<int ASSOC> static int victim(cacheMemory &cache, int, int block_start){ return oldest_way<ASSOC>(&cache.last_used[block_start], cache.assoc_deg); }
+};
+
+// First in first out: evicts the block with the oldest fill time
+struct fifoPolicy{
+    static void init(cacheMemory &cache){ cache.inserted.assign(cache.num_sets * cache.assoc_deg, -1); }
+    template<int ASSOC> static void on_hit(cacheMemory &, int, int, int, const memOp &, long long){}
+    template<int ASSOC> static void on_fill(cacheMemory &cache, int, int, int block, const memOp &, long long now, bool){ cache.inserted[block] = now; }
+    template<int ASSOC> static int victim(cacheMemory &cache, int, int block_start){ return oldest_way<ASSOC>(&cache.inserted[block_start], cache.assoc_deg); }
+};
+
+// Optimal (Belady MIN): evicts the block used furthest in the future, kept on top of the set's OPT heap
+struct optPolicy{
+    static void init(cacheMemory &cache){
+        int num_cache_blocks = cache.num_sets * cache.assoc_deg; // Total number of cache blocks
+        cache.next_use.assign(num_cache_blocks, NEVER_USED);
+        cache.opt_heap.assign(num_cache_blocks, 0);
+        cache.opt_heap_pos.assign(num_cache_blocks, 0);
+        cache.opt_heap_size.assign(cache.num_sets, 0);
+    }
+    template<int ASSOC> static void on_hit(cacheMemory &cache, int cache_set, int way, int block, const memOp &op, long long){
+        cache.next_use[block] = op.next_use;
+        cache.opt_update(cache_set, way);
+    }
+    template<int ASSOC> static void on_fill(cacheMemory &cache, int cache_set, int way, int block, const memOp &op, long long, bool fill_empty){
+        cache.next_use[block] = op.next_use;
+        if(fill_empty)
+            cache.opt_push(cache_set, way);
+        else
+            cache.opt_update(cache_set, way);
+    }
+    template<int ASSOC> static int victim(cacheMemory &cache, int cache_set, int){ return cache.opt_victim(cache_set); }
+};
+
+// Tree pseudo-LRU: one bit per node of a binary tree over the ways points towards
+// the half to evict next. Needs a power-of-two associativity of at most 64
+struct plruPolicy{
+    static void init(cacheMemory &cache){ cache.plru_bits.assign(cache.num_sets, 0); }
+    // Points every node on the way's path away from the way
+    template<int ASSOC>
+    static void touch(cacheMemory &cache, int cache_set, int way){
+        uint64_t bits = cache.plru_bits[cache_set]; // Tree bits of the cache set
+        int node = 0; // Current tree node (children of n are 2n+1 and 2n+2)
+        int low = 0; // First way under the current node
+        for(int size=(ASSOC ? ASSOC : cache.assoc_deg); size > 1; size /= 2){
+            int half = size / 2; // Ways under each child
+            if(way < low + half){
+                bits |= 1ULL << node; // Way is on the left, evict from the right next
+                node = 2 * node + 1;
+            }else{
+                bits &= ~(1ULL << node); // Way is on the right, evict from the left next
+                low += half;
+                node = 2 * node + 2;
+            }
+        }
+        cache.plru_bits[cache_set] = bits;
+    }
+    template<int ASSOC> static void on_hit(cacheMemory &cache, int cache_set, int way, int, const memOp &, long long){ touch<ASSOC>(cache, cache_set, way); }
+    template<int ASSOC> static void on_fill(cacheMemory &cache, int cache_set, int way, int, const memOp &, long long, bool){ touch<ASSOC>(cache, cache_set, way); }
+    template<int ASSOC> static int victim(cacheMemory &cache, int cache_set, int){
+        uint64_t bits = cache.plru_bits[cache_set]; // Tree bits of the cache set
+        int node = 0; // Current tree node
+        int low = 0; // First way under the current node
+        // Follow the bits from the root down to a way
+        for(int size=(ASSOC ? ASSOC : cache.assoc_deg); size > 1; size /= 2){
+            if(bits & (1ULL << node)){
+                low += size / 2;
+                node = 2 * node + 2;
+            }else{
+                node = 2 * node + 1;
+            }
+        }
+        return low;
+    }
+};
+
+// Static re-reference interval prediction (2-bit RRPV): hits predict near re-reference,
+// fills predict a long re-reference interval, and a block predicted distant is evicted
+struct srripPolicy{
+    static constexpr uint8_t RRPV_MAX = 3; // Re-reference prediction value of a distant block
+    static void init(cacheMemory &cache){ cache.rrpv.assign(cache.num_sets * cache.assoc_deg, RRPV_MAX); }
+    template<int ASSOC> static void on_hit(cacheMemory &cache, int, int, int block, const memOp &, long long){ cache.rrpv[block] = 0; }
+    template<int ASSOC> static void on_fill(cacheMemory &cache, int, int, int block, const memOp &, long long, bool){ cache.rrpv[block] = RRPV_MAX - 1; }
+    template<int ASSOC> static int victim(cacheMemory &cache, int, int block_start){
+        const int assoc = ASSOC ? ASSOC : cache.assoc_deg; // Ways per cache set
+        uint8_t* set_rrpv = &cache.rrpv[block_start]; // RRPVs of the cache set
+        // Age the whole set until a block is predicted distant, then evict the first one
+        while(true){
+            for(int way=0; way < assoc; way++){
+                if(set_rrpv[way] >= RRPV_MAX)
+                    return way;
+            }
+            for(int way=0; way < assoc; way++)
+                set_rrpv[way]++;
+        }
+    }
+};
+
+// Bimodal RRIP: like SRRIP but fills are predicted distant, except 1 in 32 which are
+// predicted long, so a scan or thrashing working set cannot flush the whole cache
+struct brripPolicy : srripPolicy{
+    static constexpr uint64_t LONG_INSERT_ODDS = 32; // One in this many fills is predicted long
+    static void init(cacheMemory &cache){
+        srripPolicy::init(cache);
+        cache.rng_state.resize(cache.num_sets);
+        for(int cache_set=0; cache_set < cache.num_sets; cache_set++)
+            cache.rng_state[cache_set] = seed_random(cache_set);
+    }
+    template<int ASSOC> static void on_fill(cacheMemory &cache, int cache_set, int, int block, const memOp &, long long, bool){
+        bool long_insert = next_random(cache.rng_state[cache_set]) % LONG_INSERT_ODDS == 0;
+        cache.rrpv[block] = long_insert ? RRPV_MAX - 1 : RRPV_MAX;
+    }
+};
+
+// Random: evicts a uniformly random way, drawn from a per cache set generator
+struct randomPolicy{
+    static void init(cacheMemory &cache){
+        cache.rng_state.resize(cache.num_sets);
+        for(int cache_set=0; cache_set < cache.num_sets; cache_set++)
+            cache.rng_state[cache_set] = seed_random(cache_set);
+    }
+    template<int ASSOC> static void on_hit(cacheMemory &, int, int, int, const memOp &, long long){}
+    template<int ASSOC> static void on_fill(cacheMemory &, int, int, int, const memOp &, long long, bool){}
+    template<int ASSOC> static int victim(cacheMemory &cache, int cache_set, int){ return (int)(next_random(cache.rng_state[cache_set]) % (ASSOC ? ASSOC : cache.assoc_deg)); }
+};
+
+// Least frequently used: evicts the block with the fewest accesses since its fill,
+// the oldest fill among equally used blocks
+struct lfuPolicy{
+    static void init(cacheMemory &cache){
+        cache.use_count.assign(cache.num_sets * cache.assoc_deg, 0);
+        cache.inserted.assign(cache.num_sets * cache.assoc_deg, -1);
+    }
+    template<int ASSOC> static void on_hit(cacheMemory &cache, int, int, int block, const memOp &, long long){ cache.use_count[block]++; }
+    template<int ASSOC> static void on_fill(cacheMemory &cache, int, int, int block, const memOp &, long long now, bool){
+        cache.use_count[block] = 1;
+        cache.inserted[block] = now;
+    }
+    template<int ASSOC> static int victim(cacheMemory &cache, int, int block_start){
+        const int assoc = ASSOC ? ASSOC : cache.assoc_deg; // Ways per cache set
+        int victim_way = 0; // Least frequently used way so far
+        for(int way=1; way < assoc; way++){
+            uint32_t count = cache.use_count[block_start + way];
+            uint32_t victim_count = cache.use_count[block_start + victim_way];
+            if(count < victim_count || (count == victim_count && cache.inserted[block_start + way] < cache.inserted[block_start + victim_way]))
+                victim_way = way;
+        }
+        return victim_way;
+    }
+};
+
+/**************************************************************************************
+Function name:         dispatch_policy(char replace_policy, Visitor visit)
+Input parameters:      Character replace_policy: The replacement policy letter
+                       Visitor visit: Generic callable, called with a default constructed
+                           value of the policy's structure
+Return value:          Boolean: Whether the policy letter is known
+Purpose:               Maps a replacement policy letter to its compile-time policy. This is
+                       the only place policy letters are listed
+**************************************************************************************/
+template<class Visitor>
+bool dispatch_policy(char replace_policy, Visitor &&visit){
+    switch(toupper(replace_policy)){
+        case 'L': visit(lruPolicy()); return true;
+        case 'F': visit(fifoPolicy()); return true;
+        case 'O': visit(optPolicy()); return true;
+        case 'P': visit(plruPolicy()); return true;
+        case 'S': visit(srripPolicy()); return true;
+        case 'B': visit(brripPolicy()); return true;
+        case 'R': visit(randomPolicy()); return true;
+        case 'U': visit(lfuPolicy()); return true;
+        default: return false;
+    }
+}
+
+/**************************************************************************************
+Function name:         valid_policy(char replace_policy, int assoc_deg)
+Input parameters:      Character replace_policy: The replacement policy letter
+                       Integer assoc_deg: The degree of association of the cache
+Return value:          Boolean: Whether the policy exists and supports the associativity
+Purpose:               Validates a replacement policy choice
+**************************************************************************************/
+bool valid_policy(char replace_policy, int assoc_deg){
+    // Tree-PLRU needs a full binary tree that fits in one 64-bit word per set
+    if(toupper(replace_policy) == 'P')
+        return assoc_deg <= 64 && (assoc_deg & (assoc_deg - 1)) == 0;
+    return dispatch_policy(replace_policy, [](auto){});
+}
+
+// Floor of the base 2 logarithm of a positive integer, usable at compile time
+constexpr int floor_log2(unsigned long long value){ return value > 1 ? 1 + floor_log2(value >> 1) : 0; }
+// Ceiling of the base 2 logarithm of a positive integer (the bits needed to number that many values)
+constexpr int ceil_log2(unsigned long long value){ return value > 1 ? 1 + floor_log2(value - 1) : 0; }
+// Whether a positive integer is a power of two
+constexpr bool is_pow2(unsigned long long value){ return value > 0 && (value & (value - 1)) == 0; }
+
+/**************************************************************************************
+Function name:         parse_tag(uint64_t mem_block, int num_sets)
+Input parameters:      uint64_t mem_block: The main memory block number
+                       Integer num_sets: The number of cache sets
+Return value:          uint64_t: The packed tag bits
+Purpose:               Extracts the main memory address tag bits. With a power of two number
+                       of cache sets these are the address bits above the offset and index
+                       bits. Any number of sets works, and tag * num_sets + cache set gives
+                       the block back, so the cache does not store block numbers
+***************************************************************************************/
+uint64_t parse_tag(uint64_t mem_block, int num_sets){
+    // Divide out the cache set index, leaving only the tag bits
+    return mem_block / num_sets;
+}
+
+/*
+    Memory Simulator Class
+
+Used to store all necessary information for the simulation
+of a memory hierarchy and memory operations.
+
+Members:
+    uint64_t size_main_mem: The main memory size in bytes, up to 2^64 - 1 (a full 64-bit
+        address space). Addresses are 64-bit, so addresses past it are still
+        simulated (their tags just have more bits)
+    Integer size_cache: The cache memory size in bytes
+    Integer size_line: The size of a line/block of memory
+    Integer assoc_deg: The degree of association of the cache
+    Character replace_policy: The system's replace policy
+        "L" for least-recently-used,
+        "F" for first-in-first-out,
+        "O" for optimal (Belady MIN, evicts the block used furthest in the future),
+        "P" for tree pseudo-LRU, "S" for SRRIP, "B" for BRRIP, "R" for random
+        or "U" for least-frequently-used (see Replacement Policies)
+    String input_filename: The filename of the memory instructions file
+    Integer num_tag_bits: The number of tag bits in the memory addresses
+    Integer num_addr_lines: The number of main memory address lines/bits
+    Integer num_offset_bits: The number of block offset bits in the memory addresses
+    Integer num_index_bits: The number of cache set index bits in the memory addresses
+    Long access_clock: Number of memory operations executed so far. Used to
+        timestamp cache block accesses and fills for the replacement policies
+    Boolean write_back: Whether writes only dirty the cache (write-back) rather than
+        also being sent to memory (write-through)
+    Boolean write_allocate: Whether a write miss fills the block into the cache
+        rather than only being sent to memory (no-write-allocate)
+    memTraffic traffic: The memory traffic of the operations executed so far
+    Long num_hits: The number of operations executed so far that hit, counted by the kernel
+    setCounters set_counters: Per cache set counters filled in by the kernel, or NULL. Sharded
+        runs update them safely since every cache set belongs to one shard
+    decodeKernel decode_kernel: The decoder compiled for the geometry, or NULL for the
+        generic decoder (see select_kernels)
+    execKernel exec_kernel: The simulator kernel compiled for the associativity (see select_kernels)
+*/
+class MemorySim{
+public:
+    // Decoder of memory operations compiled for one line size and number of cache sets
+    typedef void (*decodeKernel)(memOp ops[], int num_ops, int assoc_deg);
+    // Simulator kernel compiled for one associativity, returns the hits or -1 for an unknown policy
+    typedef long long (MemorySim::*execKernel)(char policy, memOp ops[], const int order[], int num_ops,
+                                                cacheMemory &cache, long long clock_base, memTraffic &traffic);
+
+    uint64_t size_main_mem;
+    int size_cache;
+    int size_line;
+    int assoc_deg;
+    char replace_policy;
+    string input_filename;
+    int num_tag_bits;
+    int num_addr_lines;
+    int num_offset_bits;
+    int num_index_bits;
+    long long access_clock;
+    bool write_back;
+    bool write_allocate;
+    memTraffic traffic;
+    long long num_hits;
+    setCounters* set_counters;
+    decodeKernel decode_kernel;
+    execKernel exec_kernel;
+
+    // Default constructor, write-back and write-allocate like the original simulator
+    MemorySim(){
+        access_clock = 0; write_back = true; write_allocate = true; num_hits = 0; set_counters = NULL;
+        decode_kernel = NULL; exec_kernel = &MemorySim::exec_assoc<0>;
+    }
+
+    /**********************************************************************************
+    Function name:         calc_layout()
+    Input parameters:      None
+    Return value:          Void - Returns nothing
+    Purpose:               Calculates the memory address layout without displaying it
+    ***********************************************************************************/
+    void calc_layout(){
+        // Calculate number of address lines (64 for a 2^64 - 1 byte memory)
+        num_addr_lines = ceil_log2(size_main_mem);
+        // Calculate number of offset bits
+        num_offset_bits = floor_log2(size_line);
+        // Calculate number of index bits
+        num_index_bits = floor_log2(size_cache / size_line / assoc_deg);
+        // Calculate number of tag bits
+        num_tag_bits = num_addr_lines - num_offset_bits - num_index_bits;
+        // Pick the kernels compiled for this geometry
+        select_kernels();
+    }
+
+    /**********************************************************************************
+    Function name:         select_kernels()
+    Input parameters:      None
+    Return value:          Void - Returns nothing
+    Purpose:               Looks the cache geometry up in the pre-instantiated kernels.
+                           Power of two line sizes from 16 to 256 bytes with any power of
+                           two number of sets up to 2^MAX_FIXED_SET_BITS (last level caches
+                           included) get a decoder with constant shifts and masks, common
+                           associativities a simulator kernel with constant way loop
+                           bounds. Anything else uses the generic decoder and kernel
+    ***********************************************************************************/
+    void select_kernels(){
+        struct execEntry { int assoc_deg; execKernel kernel; };
+        static const execEntry EXEC_KERNELS[] = {
+            {1, &MemorySim::exec_assoc<1>}, {2, &MemorySim::exec_assoc<2>}, {4, &MemorySim::exec_assoc<4>},
+            {8, &MemorySim::exec_assoc<8>}, {16, &MemorySim::exec_assoc<16>},
+        };
+        int num_sets = size_cache / size_line / assoc_deg; // Number of cache sets
+        switch(size_line){
+            case 16: decode_kernel = fixed_decoder<16>(num_sets); break;
+            case 32: decode_kernel = fixed_decoder<32>(num_sets); break;
+            case 64: decode_kernel = fixed_decoder<64>(num_sets); break;
+            case 128: decode_kernel = fixed_decoder<128>(num_sets); break;
+            case 256: decode_kernel = fixed_decoder<256>(num_sets); break;
+            default: decode_kernel = NULL;
+        }
+        exec_kernel = &MemorySim::exec_assoc<0>;
+        for(const execEntry &entry : EXEC_KERNELS){
+            if(entry.assoc_deg == assoc_deg)
+                exec_kernel = entry.kernel;
+        }
+    }
+
+    /**********************************************************************************
+    Function name:         calc_mem_addr_layout()
+    Input parameters:      None
+    Return value:          Void - Returns nothing
+    Purpose:               Calculates and displays various memory simulator parameters necessary for operation
+    ***********************************************************************************/
+    void calc_mem_addr_layout(){
+        // Calculate the address layout
+        calc_layout();
+        cout << "\nSimulator Output:" << endl;
+        // Print the address layout to screen
+        cout << "Total address lines required = " << num_addr_lines << endl;
+        cout << "Number of bits for offset = " << num_offset_bits << endl;
+        cout << "Number of bits for index = " << num_index_bits << endl;
+        cout << "Number of bits for tag = " << num_tag_bits << endl;
+        // Calculate cache size required and print to screen
+        // num_cache_blks * (1+1(dirty and valid bits) + num_tag_bits + 8 * block_size) / 8
+        int size_total_cache = (int)(size_cache / size_line * (1 + 1 + num_tag_bits) / 8 + size_cache);
+        cout << "Total cache size required = " << size_total_cache << " bytes";
+    }
+
+    /**********************************************************************************
+    Function name:    decode_ops(memOp ops[], int num_ops)
+    Input parameters: memOp ops[]: The array of memory operations with type and address set
+                      integer num_ops: The number of memory operations
+    Return value:     Void - Returns nothing
+    Purpose:          Calculates each memory operation's block, cache set and tag
+    **********************************************************************************/
+    void decode_ops(memOp ops[], int num_ops){
+        // Use the decoder compiled for this geometry if there is one
+        if(decode_kernel != NULL){
+            decode_kernel(ops, num_ops, assoc_deg);
+            return;
+        }
+        // Generic decoder: runtime geometry
+        // Number of cache sets in the cache
+        int num_sets = size_cache / size_line / assoc_deg;
+        // Iterate through the memory operations
+        for(int i=0; i < num_ops; i++){
+            // Calculate and set memory operation main memory block
+            ops[i].mem_block = ops[i].mem_address / size_line;
+            // Calculate and set memory operation cache set
+            ops[i].cache_set = (int)(ops[i].mem_block % num_sets);
+            // Calculate and set memory operation starting cache block
+            ops[i].cache_block_start = ops[i].cache_set * assoc_deg;
+            // Initialize memory operation result to unknown
+            ops[i].result = RESULT_UNKNOWN;
+            // Set memory operation address tag
+            ops[i].tag = parse_tag(ops[i].mem_block, num_sets);
+        }
+    }
+
+    /**********************************************************************************
+    Function name:    decode_fixed<LINE, SETS>(memOp ops[], int num_ops, int assoc_deg)
+    Input parameters: LINE, SETS: The line size and number of cache sets, powers of two
+                      memOp ops[]: The array of memory operations with type and address set
+                      integer num_ops: The number of memory operations
+                      integer assoc_deg: The degree of association of the cache
+    Return value:     Void - Returns nothing
+    Purpose:          Same as the generic decode_ops, with the divide, modulo and tag
+                      shift reduced to constant shifts and masks
+    **********************************************************************************/
+    template<int LINE, int SETS>
+    static void decode_fixed(memOp ops[], int num_ops, int assoc_deg){
+        static_assert(is_pow2(LINE) && is_pow2(SETS), "fixed geometry must be powers of two");
+        constexpr int OFFSET_BITS = floor_log2(LINE); // Block offset bits of an address
+        constexpr int INDEX_BITS = floor_log2(SETS); // Cache set index bits of an address
+        for(int i=0; i < num_ops; i++){
+            uint64_t mem_address = ops[i].mem_address; // Address of the operation
+            ops[i].mem_block = mem_address >> OFFSET_BITS;
+            ops[i].cache_set = (int)(ops[i].mem_block & (SETS - 1));
+            ops[i].cache_block_start = ops[i].cache_set * assoc_deg;
+            ops[i].result = RESULT_UNKNOWN;
+            ops[i].tag = mem_address >> (OFFSET_BITS + INDEX_BITS);
+        }
+    }
+
+    // Largest number of set index bits with a fixed geometry decoder
+    static constexpr int MAX_FIXED_SET_BITS = 20;
+
+    // Returns the fixed geometry decoder for LINE byte lines and num_sets sets, trying
+    // 2^SET_BITS sets and up, or NULL if num_sets is not a power of two that has one
+    template<int LINE, int SET_BITS = 0>
+    static decodeKernel fixed_decoder(int num_sets){
+        if constexpr(SET_BITS > MAX_FIXED_SET_BITS)
+            return NULL;
+        else
+            return num_sets == (1 << SET_BITS) ? &decode_fixed<LINE, (1 << SET_BITS)> : fixed_decoder<LINE, SET_BITS + 1>(num_sets);
+    }
+
+    /**********************************************************************************
+    Function name:    exec_assoc<ASSOC>(char policy, memOp ops[], const int order[], int num_ops,
+                                        cacheMemory &cache, long long clock_base, memTraffic &traffic)
+    Input parameters: ASSOC: The associativity compiled in, or 0 for the generic kernel
+                      Character policy: The replacement policy letter
+                      Other parameters: See run_ops
+    Return value:     Long: The number of hits, or -1 for an unknown replacement policy
+    Purpose:          Selects the replacement policy once per batch and runs the kernel
+                      compiled for the policy and associativity
+    **********************************************************************************/
+    template<int ASSOC>
+    long long exec_assoc(char policy, memOp ops[], const int order[], int num_ops, cacheMemory &cache,
+                         long long clock_base, memTraffic &traffic){
+        long long batch_hits = -1; // Number of hits of the batch
+        dispatch_policy(policy, [&](auto policy_type){
+            batch_hits = run_ops<decltype(policy_type), ASSOC>(ops, order, num_ops, cache, clock_base, traffic);
+        });
+        return batch_hits;
+    }
+
+    /**********************************************************************************
+    Function name:    exec_ops(memOp ops[], int num_ops, cacheMemory &cache)
+    Input parameters: memOp ops[]: The array of memory operations to be executed
+                      integer num_ops: The number of memory operations
+                      cacheMemory cache: The cache memory being simulated
+    Return value:     Void - Returns nothing
+    Purpose:          Runs the memory operations with the given cache memory and simulator
+                      parameters, using the kernel compiled for the replacement policy and
+                      associativity
+    **********************************************************************************/
+    void exec_ops(memOp ops[], int num_ops, cacheMemory &cache){
+        exec_ops_subset(ops, num_ops, NULL, num_ops, cache);
+    }
+
+    /**********************************************************************************
+    Function name:    exec_ops_subset(memOp ops[], int num_ops, const int order[], int num_order,
+                                      cacheMemory &cache)
+    Input parameters: memOp ops[]: The batch of memory operations
+                      integer num_ops: The number of memory operations in the batch
+                      integer order[]: The indices of the operations to execute, in order,
+                          or NULL to execute the whole batch
+                      integer num_order: The number of operations to execute
+                      cacheMemory cache: The cache memory being simulated
+    Return value:     Void - Returns nothing
+    Purpose:          Same as exec_ops for only some operations of the batch (e.g. the
+                      ones in sampled cache sets). The clock still advances past the batch
+    **********************************************************************************/
+    void exec_ops_subset(memOp ops[], int num_ops, const int order[], int num_order, cacheMemory &cache){
+        // Select the policy once per batch, the kernel has it inlined
+        long long batch_hits = (this->*exec_kernel)(replace_policy, ops, order, num_order, cache, access_clock, traffic);
+        // If invalid replacement policy
+        // should NOT happen since in 487
+        if(batch_hits < 0)
+            printf("---Invalid replacement policy!---\n");
+        else
+            num_hits += batch_hits;
+        access_clock += num_ops; // Advance the simulator clock past the batch
+    }
+
+    /**********************************************************************************
+    Function name:    run_ops<Policy, ASSOC>(memOp ops[], const int order[], int num_ops, cacheMemory &cache,
+                                             long long clock_base, memTraffic &traffic)
+    Input parameters: Policy: The replacement policy structure (see Replacement Policies)
+                      ASSOC: The associativity compiled in, or 0 to use the cache's
+                      memOp ops[]: The array of memory operations to be executed
+                      integer order[]: The indices of the memory operations to execute, in
+                          order, or NULL to execute ops[0] to ops[num_ops-1]
+                      integer num_ops: The number of memory operations to execute
+                      cacheMemory cache: The cache memory being simulated
+                      long clock_base: The simulator clock value of ops[0]
+                      memTraffic traffic: The memory traffic counters to add to
+    Return value:     Long: The number of memory operations that hit
+    Purpose:          Simulator kernel. Runs the memory operations with the given replacement
+                      policy and the simulator's write policy, counting hits and memory traffic
+    **********************************************************************************/
+    template<class Policy, int ASSOC>
+    long long run_ops(memOp ops[], const int order[], int num_ops, cacheMemory &cache, long long clock_base, memTraffic &traffic){
+        int way; // Variable to store the cache set way being operated on
+        int cache_block_idx; // Variable to store the current cache block index to be searched
+        long long now; // Simulator clock value of the current memory operation
+        bool is_write; // Whether the current memory operation is a write
+        long long batch_hits = 0; // Number of memory operations that hit
+        //cout << "Executing operations" << endl;
+        // Iterate through all memory operations
+        for(int k=0; k < num_ops; k++){
+            // Index of the memory operation to execute
+            int i = (order == NULL) ? k : order[k];
+            //printf("\nMem op: %d, address: %d,  tag: %lu\n", i, ops[i].mem_address, ops[i].tag);
+            // Timestamp this operation with its position in the trace
+            now = clock_base + i;
+            // Cache set of the operation
+            int cache_set = ops[i].cache_set;
+            is_write = (ops[i].op_type == 'W' || ops[i].op_type == 'w');
+            if(set_counters != NULL)
+                set_counters->accesses[cache_set]++;
+
+            // Search through memory block's associated cache blocks in its cache set
+            way = cache.find_tag<ASSOC>(cache_set, ops[i].tag);
+
+            // If the main memory address tag and a cache tag match
+            if(way >= 0){
+                //printf("Tag match found!\n");
+                cache_block_idx = ops[i].cache_block_start + way;
+                ops[i].result = RESULT_HIT; // Set operation result as hit
+                batch_hits++;
+                // Update the replacement policy metadata
+                Policy::template on_hit<ASSOC>(cache, cache_set, way, cache_block_idx, ops[i], now);
+
+                // If the operation was a write
+                if(is_write){
+                    //printf("Writing dirty bit!\n");
+                    // Write-back: set cache block dirty flag to true
+                    if(write_back)
+                        cache.set_dirty(cache_set, way, true);
+                    // Write-through: the block stays clean, the write goes to memory
+                    else
+                        traffic.num_write_throughs++;
+                }
+            }
+
+            // Write miss without write-allocate: the write goes straight to memory
+            // and the cache is left untouched
+            else if(is_write && !write_allocate){
+                ops[i].result = RESULT_MISS; // Set operation result to miss
+                traffic.num_write_throughs++;
+                if(set_counters != NULL)
+                    set_counters->misses[cache_set]++;
+            }
+
+            // If the desired main memory tag was not found in cache
+            // Find the replacement policy's block to overwrite. => Miss
+            else{
+                int cache_block_to_edit; // Cache block to fill
+                ops[i].result = RESULT_MISS; // Set operation result to miss
+                if(set_counters != NULL)
+                    set_counters->misses[cache_set]++;
+
+                // Check to see if the cache set has a block that has not
+                // been written to this simulator execution run.
+                way = cache.find_empty<ASSOC>(cache_set);
+                bool fill_empty = (way >= 0); // Whether the block is filled into an empty way
+                // If no 'empty' cache blocks were found, use replacement policy as given by user.
+                if(!fill_empty){
+                    way = Policy::template victim<ASSOC>(cache, cache_set, ops[i].cache_block_start);
+                    // A dirty victim is written back to memory before it is replaced
+                    bool dirty_victim = cache.is_dirty(cache_set, way);
+                    if(dirty_victim)
+                        traffic.num_writebacks++;
+                    if(set_counters != NULL){
+                        set_counters->evictions[cache_set]++;
+                        set_counters->dirty_evictions[cache_set] += dirty_victim;
+                    }
+                }
+                cache_block_to_edit = ops[i].cache_block_start + way;
+                // The block is read from memory into the cache
+                traffic.num_fills++;
+
+                // Execute memory operation on given block (empty or otherwise)
+
+                // Set cache block to valid
+                cache.set_valid(cache_set, way);
+                // Set cache block tag to main memory address tag
+                cache.tags[cache_block_to_edit] = ops[i].tag;
+                // Update the replacement policy metadata for the new block
+                Policy::template on_fill<ASSOC>(cache, cache_set, way, cache_block_to_edit, ops[i], now, fill_empty);
+                // The filled block is dirty after a write-back write
+                cache.set_dirty(cache_set, way, is_write && write_back);
+                // A write-through write is also sent to memory
+                if(is_write && !write_back)
+                    traffic.num_write_throughs++;
+            }
+        }
+        return batch_hits;
+    }
+};
+
+/*
+    Binary trace file header. Binary traces are this header followed by
+    num_records memory references in the given encoding:
+      TRACE_BIN_FIXED: groups of FIXED_GROUP_REFS references (the last group may
+          be shorter), each a little-endian uint64_t of write flags (bit k set if
+          reference k of the group is a write) followed by one little-endian
+          uint64_t address per reference, readable in place from the mapped file
+      TRACE_BIN_DELTA: one LEB128 varint per reference holding the 65-bit value
+          (zigzag(address - previous address) << 1) | is_write, the address
+          delta wrapping around the 64-bit address space
+    Version 1 files packed the write flag into the address word, so only held
+    63-bit addresses, and are no longer read
+
+Members:
+    Character magic: BIN_TRACE_MAGIC, identifies a binary trace file
+    Integer version: The format version, BIN_TRACE_VERSION
+    Integer encoding: The record encoding (TRACE_BIN_FIXED or TRACE_BIN_DELTA)
+    Long num_records: The number of memory references in the file
+*/
+struct binTraceHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t encoding;
+    uint64_t num_records;
+};
+const char BIN_TRACE_MAGIC[8] = {'M', 'E', 'M', 'T', 'R', 'A', 'C', 'E'};
+const uint32_t BIN_TRACE_VERSION = 2;
+// Trace file formats understood by the trace reader
+enum traceFormat { TRACE_TEXT = 0, TRACE_BIN_FIXED = 1, TRACE_BIN_DELTA = 2 };
+
+// References per group of a fixed width binary trace, which share one word of write flags
+const int FIXED_GROUP_REFS = 64;
+
+/*
+    Trace records structure: a whole trace held in memory, for the modes that
+    need more than one pass over it (sweeps, OPT). Addresses are kept as full
+    64-bit words and the write flags in a separate bitmap, so a reference costs
+    8 bytes and 1 bit and every address fits
+
+Members:
+    Vector addresses: The main memory address of each reference
+    Vector write_bits: Bit i % 64 of word i / 64 is set if reference i is a write
+*/
+struct traceRecords{
+    vector<uint64_t> addresses;
+    vector<uint64_t> write_bits;
+
+    // Number of references
+    size_t size() const { return addresses.size(); }
+    // Reserves room for a number of references
+    void reserve(size_t num_refs){
+        addresses.reserve(num_refs);
+        write_bits.reserve((num_refs + 63) / 64);
+    }
+    // Removes every reference
+    void clear(){
+        addresses.clear();
+        write_bits.clear();
+    }
+    // Whether a reference is a write
+    bool is_write(size_t ref) const { return (write_bits[ref >> 6] >> (ref & 63)) & 1; }
+    // Appends a memory reference
+    void push_back(char op_type, uint64_t mem_address){
+        size_t ref = addresses.size(); // Index of the new reference
+        if((ref & 63) == 0)
+            write_bits.push_back(0);
+        write_bits.back() |= (uint64_t)(op_type == 'W' || op_type == 'w') << (ref & 63);
+        addresses.push_back(mem_address);
+    }
+    // Unpacks num_refs references starting at first into the type and address of memory operations
+    void unpack(size_t first, int num_refs, memOp ops[]) const {
+        for(int k=0; k < num_refs; k++){
+            ops[k].op_type = is_write(first + k) ? 'W' : 'R';
+            ops[k].mem_address = addresses[first + k];
+        }
+    }
+};
+
+/*
+    Trace Reader Class
+
+Streams memory operations out of a trace file in fixed-size batches. The
+file is memory mapped one window at a time so memory use does not grow with
+the trace length. Text traces ("R 36" per line) are parsed in place with
+from_chars; a leading memory operation count line is optional and, when
+present, no more than that many operations are read. Text traces of several
+cores ("0 R 36") carry the issuing core in a leading column. Binary traces (see
+binTraceHeader) are detected by their magic and their records are unpacked
+straight from the mapping without any parsing.
+
+Members:
+    Integer fd: The file descriptor of the open trace file
+    Integer format: The trace file format (traceFormat)
+    Long file_size: The size of the trace file in bytes
+    Pointer window: The currently mapped window of the trace file
+    Long window_offset: The file offset of the start of the mapped window
+    Long window_size: The number of bytes mapped in the window
+    Long pos: The file offset of the next byte to parse
+    Long ops_remaining: Operations left to read, or -1 if the count is unknown
+    uint64_t prev_address: The previous address of a delta encoded binary trace
+    uint64_t group_flags: The write flags of the current fixed width group
+    Integer group_ref: The next reference of the current fixed width group
+        (FIXED_GROUP_REFS at the start of a group)
+    Boolean core_ids: Whether text records start with a core-ID column
+*/
+class traceReader{
+public:
+    int fd;
+    int format;
+    long long file_size;
+    const char* window;
+    long long window_offset;
+    long long window_size;
+    long long pos;
+    long long ops_remaining;
+    uint64_t prev_address;
+    uint64_t group_flags;
+    int group_ref;
+    bool core_ids;
+
+    traceReader(){ fd = -1; window = NULL; } // Default constructor
+    ~traceReader(){ close_trace(); } // Unmap and close on destruction
+
+    /**********************************************************************************
+    Function name:    open_trace(string filename, bool core_ids)
+    Input parameters: String filename: The name of the trace file
+                      Boolean core_ids: Whether the trace is a text trace whose records
+                          start with a core-ID column
+    Return value:     Boolean: Whether the trace file was opened
+    Purpose:          Opens and maps the trace file, detects its format and skips
+                      the binary header or the optional text count line
+    **********************************************************************************/
+    bool open_trace(string filename, bool core_ids = false){
+        struct stat file_stat; // File status used to get the file size
+        close_trace(); // Release any previously opened trace
+        fd = open(filename.c_str(), O_RDONLY);
+        if(fd < 0 || fstat(fd, &file_stat) != 0)
+            return false;
+        file_size = file_stat.st_size;
+        window_offset = 0;
+        window_size = 0;
+        pos = 0;
+        ops_remaining = -1;
+        prev_address = 0;
+        group_flags = 0;
+        group_ref = FIXED_GROUP_REFS;
+        format = TRACE_TEXT;
+        this->core_ids = core_ids;
+        if(!map_window())
+            return false;
+
+        // If the file starts with the binary magic, read the binary header
+        if(window_size >= (long long)sizeof(binTraceHeader) && memcmp(window, BIN_TRACE_MAGIC, sizeof(BIN_TRACE_MAGIC)) == 0){
+            binTraceHeader header; // Header of the binary trace
+            memcpy(&header, window, sizeof(header));
+            if(header.version != BIN_TRACE_VERSION || (header.encoding != TRACE_BIN_FIXED && header.encoding != TRACE_BIN_DELTA)){
+                printf("---Unsupported binary trace version %u encoding %u!---\n", header.version, header.encoding);
+                return false;
+            }
+            if(core_ids){
+                printf("---A trace with core IDs must be a text trace!---\n");
+                return false;
+            }
+            format = header.encoding;
+            ops_remaining = header.num_records;
+            pos = sizeof(binTraceHeader);
+            return true;
+        }
+
+        // If the first token is a number, it is the memory operation count line
+        // (with core IDs, only if it is the only token of the line)
+        skip_space();
+        if(pos < file_size && isdigit((unsigned char)window[pos - window_offset])){
+            const char* first = window + (pos - window_offset);
+            const char* cur = from_chars(first, window + window_size, ops_remaining).ptr; // End of the number
+            while(cur < window + window_size && (*cur == ' ' || *cur == '\t' || *cur == '\r'))
+                cur++;
+            if(core_ids && cur < window + window_size && *cur != '\n'){
+                ops_remaining = -1;
+                return true;
+            }
+            // Skip the rest of the count line
+            while(pos < file_size && window[pos - window_offset] != '\n')
+                pos++;
+        }
+        return true;
+    }
+
+    /**********************************************************************************
+    Function name:    next_batch(memOp ops[], int max_ops, int cores[])
+    Input parameters: memOp ops[]: The batch to fill with memory operations
+                      Integer max_ops: The capacity of the batch
+                      Integer cores[]: The core of each memory operation, filled for a
+                          trace opened with core IDs (NULL otherwise)
+    Return value:     Integer: The number of memory operations read, 0 at end of trace
+    Purpose:          Reads the next batch of memory operations (type and address only)
+    **********************************************************************************/
+    int next_batch(memOp ops[], int max_ops, int cores[] = NULL){
+        int num_ops; // Number of memory operations read into the batch
+        // If the operation count is known, do not read more operations than it says
+        if(ops_remaining >= 0 && ops_remaining < max_ops)
+            max_ops = (int)ops_remaining;
+
+        if(format == TRACE_BIN_FIXED)
+            num_ops = read_fixed_batch(ops, max_ops);
+        else if(format == TRACE_BIN_DELTA)
+            num_ops = read_delta_batch(ops, max_ops);
+        else
+            num_ops = parse_text_batch(ops, max_ops, cores);
+
+        if(ops_remaining >= 0)
+            ops_remaining -= num_ops;
+        return num_ops;
+    }
+
+    /**********************************************************************************
+    Function name:    close_trace()
+    Input parameters: None
+    Return value:     Void - Returns nothing
+    Purpose:          Unmaps the current window and closes the trace file
+    **********************************************************************************/
+    void close_trace(){
+        if(window != NULL)
+            munmap((void*)window, window_size);
+        if(fd >= 0)
+            close(fd);
+        window = NULL;
+        fd = -1;
+    }
+
+private:
+    // Bytes mapped at a time and the longest record that may straddle two windows
+    static constexpr long long WINDOW_BYTES = 16 << 20;
+    static constexpr long long MAX_RECORD_LEN = 64;
+    // Longest delta record varint, 65 bits in bytes of 7 bits
+    static constexpr int MAX_VARINT_BYTES = 10;
+
+    // Parses text records ("R 36", or "0 R 36" with core IDs) into the batch
+    int parse_text_batch(memOp ops[], int max_ops, int cores[]){
+        int num_ops = 0; // Number of memory operations read into the batch
+        while(num_ops < max_ops){
+            skip_space();
+            if(pos >= file_size)
+                break; // End of trace file
+            // Make sure a whole record is mapped before parsing it
+            ensure_mapped();
+
+            const char* window_end = window + window_size; // One past the last mapped byte
+            const char* cur = window + (pos - window_offset); // Current parse position
+            // Get the core ID and skip the spaces after it
+            if(core_ids){
+                int core = -1; // Core of the reference
+                cur = from_chars(cur, window_end, core).ptr;
+                if(core < 0 || cores == NULL || cur >= window_end){
+                    printf("---Invalid core ID at byte %lld of the input file!---\n", pos);
+                    pos = file_size; // Stop reading the trace
+                    break;
+                }
+                cores[num_ops] = core;
+                while(cur < window_end && (*cur == ' ' || *cur == '\t'))
+                    cur++;
+            }
+            ops[num_ops].op_type = *cur++; // Get op type from file
+            // Skip the spaces between the op type and the address
+            while(cur < window_end && (*cur == ' ' || *cur == '\t'))
+                cur++;
+            // Get memory address from file
+            from_chars_result parsed = from_chars(cur, window_end, ops[num_ops].mem_address);
+            if(parsed.ec != errc() || !(ops[num_ops].op_type == 'R' || ops[num_ops].op_type == 'r' ||
+                                        ops[num_ops].op_type == 'W' || ops[num_ops].op_type == 'w')){
+                printf("---Invalid memory reference at byte %lld of the input file!---\n", pos);
+                pos = file_size; // Stop reading the trace
+                break;
+            }
+            pos = window_offset + (parsed.ptr - window);
+            num_ops++;
+        }
+        return num_ops;
+    }
+
+    // Unpacks fixed width binary records in place from the mapped window, a group at a time
+    int read_fixed_batch(memOp ops[], int max_ops){
+        int num_ops = 0; // Number of memory operations read into the batch
+        while(num_ops < max_ops){
+            // A group starts with the write flags of its references
+            if(group_ref == FIXED_GROUP_REFS){
+                if(pos + (long long)sizeof(uint64_t) > file_size)
+                    break; // Truncated trace file
+                ensure_mapped();
+                memcpy(&group_flags, window + (pos - window_offset), sizeof(group_flags));
+                pos += sizeof(group_flags);
+                group_ref = 0;
+            }
+            if(pos + (long long)sizeof(uint64_t) > file_size)
+                break; // Truncated trace file
+            // If the window is used up, map the next one
+            if(pos + (long long)sizeof(uint64_t) > window_offset + window_size)
+                map_window();
+            // Addresses the rest of the window, group (and batch) can supply
+            long long window_refs = (window_offset + window_size - pos) / (long long)sizeof(uint64_t);
+            int batch_refs = (int)min(min((long long)(max_ops - num_ops), window_refs), (long long)(FIXED_GROUP_REFS - group_ref));
+            const uint64_t* addresses = (const uint64_t*)(window + (pos - window_offset)); // Addresses in the mapping
+            for(int k=0; k < batch_refs; k++){
+                ops[num_ops + k].op_type = ((group_flags >> (group_ref + k)) & 1) ? 'W' : 'R';
+                ops[num_ops + k].mem_address = addresses[k];
+            }
+            num_ops += batch_refs;
+            group_ref += batch_refs;
+            pos += batch_refs * (long long)sizeof(uint64_t);
+        }
+        return num_ops;
+    }
+
+    // Decodes delta and varint encoded binary records
+    int read_delta_batch(memOp ops[], int max_ops){
+        int num_ops = 0; // Number of memory operations read into the batch
+        while(num_ops < max_ops && pos < file_size){
+            // Make sure a whole record is mapped before decoding it
+            ensure_mapped();
+            const unsigned char* cur = (const unsigned char*)window + (pos - window_offset);
+            const unsigned char* window_end = (const unsigned char*)window + window_size; // One past the last mapped byte
+            // The first varint byte holds the write flag and the low 6 bits of the zigzag delta
+            unsigned char byte = *cur++; // Current varint byte
+            bool is_write = (byte & 1) != 0; // Whether the reference is a write
+            uint64_t zigzag = (byte >> 1) & 0x3f; // Zigzag encoded address delta
+            int num_bytes = 1; // Varint bytes decoded
+            bool more = (byte & 0x80) != 0; // Whether the varint continues past the current byte
+            // Decode the rest of the LEB128 varint, 7 bits per byte, high bit set on all but the last byte
+            while(more && cur < window_end && num_bytes < MAX_VARINT_BYTES){
+                byte = *cur++;
+                zigzag |= (uint64_t)(byte & 0x7f) << (6 + 7 * (num_bytes - 1));
+                more = (byte & 0x80) != 0;
+                num_bytes++;
+            }
+            // A varint that runs past 10 bytes, 65 bits or the end of the file is corrupt
+            if(more || (num_bytes == MAX_VARINT_BYTES && (byte & 0x7c) != 0)){
+                printf("---Invalid delta record at byte %lld of the input file!---\n", pos);
+                pos = file_size; // Stop reading the trace
+                break;
+            }
+            // Undo the zigzag encoding, deltas wrap around the 64-bit address space
+            long long delta = (long long)(zigzag >> 1) ^ -(long long)(zigzag & 1);
+            prev_address += (uint64_t)delta;
+            ops[num_ops].op_type = is_write ? 'W' : 'R';
+            ops[num_ops].mem_address = prev_address;
+            pos = window_offset + ((const char*)cur - window);
+            num_ops++;
+        }
+        return num_ops;
+    }
+
+    // Remaps the window if fewer than MAX_RECORD_LEN bytes are left in it
+    void ensure_mapped(){
+        if(window_offset + window_size - pos < MAX_RECORD_LEN && window_offset + window_size < file_size)
+            map_window();
+    }
+
+    // Maps the window of the file starting at the page containing the parse position
+    bool map_window(){
+        long long page_size = sysconf(_SC_PAGESIZE);
+        if(window != NULL)
+            munmap((void*)window, window_size);
+        window = NULL;
+        // mmap offsets must be page aligned
+        window_offset = pos & ~(page_size - 1);
+        window_size = min(WINDOW_BYTES, file_size - window_offset);
+        if(window_size <= 0)
+            return true; // Nothing left to map (empty file or end of file)
+        void* mapped = mmap(NULL, window_size, PROT_READ, MAP_PRIVATE, fd, window_offset);
+        if(mapped == MAP_FAILED){
+            window_size = 0;
+            return false;
+        }
+        madvise(mapped, window_size, MADV_SEQUENTIAL);
+        window = (const char*)mapped;
+        return true;
+    }
+
+    // Advances the parse position past any whitespace
+    void skip_space(){
+        while(pos < file_size){
+            if(pos >= window_offset + window_size)
+                map_window();
+            if(!isspace((unsigned char)window[pos - window_offset]))
+                break;
+            pos++;
+        }
+    }
+};
+
+// Appends a little-endian 64-bit word to a byte buffer
+inline void append_word(vector<unsigned char> &out_buf, uint64_t word){
+    out_buf.insert(out_buf.end(), (const unsigned char*)&word, (const unsigned char*)&word + sizeof(word));
+}
+
+/**************************************************************************************
+Function name:         encode_records(const memOp ops[], int num_ops, int encoding,
+                                      uint64_t &prev_address, vector<unsigned char> &out_buf)
+Input parameters:      memOp ops[]: The memory references to encode (type and address)
+                       Integer num_ops: The number of memory references
+                       Integer encoding: The binary record encoding (TRACE_BIN_FIXED or TRACE_BIN_DELTA)
+                       uint64_t prev_address: The previous address for delta encoding, updated
+                       Vector out_buf: The encoded records are appended to this buffer
+Return value:          Void - Returns nothing
+Purpose:               Encodes memory references as binary trace records. Fixed width groups
+                       start at ops[0], so every batch but the last of a trace must hold a
+                       multiple of FIXED_GROUP_REFS references
+**************************************************************************************/
+void encode_records(const memOp ops[], int num_ops, int encoding, uint64_t &prev_address, vector<unsigned char> &out_buf){
+    if(encoding == TRACE_BIN_FIXED){
+        // The write flags of a group, then its addresses
+        for(int first=0; first < num_ops; first += FIXED_GROUP_REFS){
+            int group_refs = min(FIXED_GROUP_REFS, num_ops - first); // References in the group
+            uint64_t group_flags = 0; // Write flags of the group
+            for(int k=0; k < group_refs; k++)
+                group_flags |= (uint64_t)(ops[first + k].op_type == 'W' || ops[first + k].op_type == 'w') << k;
+            append_word(out_buf, group_flags);
+            for(int k=0; k < group_refs; k++)
+                append_word(out_buf, ops[first + k].mem_address);
+        }
+        return;
+    }
+    for(int i=0; i < num_ops; i++){
+        // Zigzag the address delta so small negative strides stay short
+        uint64_t mem_address = ops[i].mem_address; // Address of the reference
+        long long delta = (long long)(mem_address - prev_address);
+        uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+        bool is_write = (ops[i].op_type == 'W' || ops[i].op_type == 'w');
+        prev_address = mem_address;
+        // Write the LEB128 varint of (zigzag << 1) | is_write, 7 bits per byte. The value
+        // has 65 bits, so the first byte takes the write flag and the low 6 zigzag bits
+        unsigned char byte = (unsigned char)(((zigzag << 1) | is_write) & 0x7f); // Current varint byte
+        uint64_t value = zigzag >> 6; // Zigzag bits left to write
+        while(value != 0){
+            out_buf.push_back(byte | 0x80);
+            byte = (unsigned char)(value & 0x7f);
+            value >>= 7;
+        }
+        out_buf.push_back(byte);
+    }
+}
+
+/**************************************************************************************
+Function name:         convert_trace(string text_filename, string bin_filename, int encoding)
+Input parameters:      String text_filename: The name of the text trace file to convert
+                       String bin_filename: The name of the binary trace file to write
+                       Integer encoding: The binary record encoding (TRACE_BIN_FIXED or TRACE_BIN_DELTA)
+Return value:          Boolean: Whether the trace was converted
+Purpose:               Converts a text trace into the binary trace format
+**************************************************************************************/
+bool convert_trace(string text_filename, string bin_filename, int encoding){
+    traceReader trace; // Reader of the text trace
+    if(!trace.open_trace(text_filename)){
+        printf("---Unable to open input file %s!---\n", text_filename.c_str());
+        return false;
+    }
+    FILE* bin_file = fopen(bin_filename.c_str(), "wb");
+    if(bin_file == NULL){
+        printf("---Unable to open output file %s!---\n", bin_filename.c_str());
+        return false;
+    }
+
+    // Write a placeholder header, the record count is filled in at the end
+    binTraceHeader header;
+    memcpy(header.magic, BIN_TRACE_MAGIC, sizeof(header.magic));
+    header.version = BIN_TRACE_VERSION;
+    header.encoding = encoding;
+    header.num_records = 0;
+    fwrite(&header, sizeof(header), 1, bin_file);
+
+    vector<memOp> operations(TRACE_BATCH_SIZE); // Batch of text trace memory operations
+    vector<unsigned char> out_buf; // Encoded records of the batch
+    int num_batch_ops; // Number of memory operations in the current batch
+    int num_read; // Number of memory operations read by one call of the reader
+    uint64_t prev_address = 0; // Previous address for delta encoding
+    // Convert the trace one batch at a time
+    while(true){
+        // Fill the whole batch, so fixed width groups only end early at the end of the trace
+        num_batch_ops = 0;
+        while(num_batch_ops < TRACE_BATCH_SIZE &&
+              (num_read = trace.next_batch(operations.data() + num_batch_ops, TRACE_BATCH_SIZE - num_batch_ops)) > 0)
+            num_batch_ops += num_read;
+        if(num_batch_ops == 0)
+            break; // End of trace
+        out_buf.clear();
+        encode_records(operations.data(), num_batch_ops, encoding, prev_address, out_buf);
+        fwrite(out_buf.data(), 1, out_buf.size(), bin_file);
+        header.num_records += num_batch_ops;
+    }
+
+    // Rewrite the header with the final record count
+    fseek(bin_file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, bin_file);
+    fseek(bin_file, 0, SEEK_END);
+    long long bin_size = ftell(bin_file); // Size of the binary trace in bytes
+    fclose(bin_file);
+    printf("Converted %llu memory references: %lld bytes -> %lld bytes\n",
+           (unsigned long long)header.num_records, trace.file_size, bin_size);
+    return true;
+}
+
+/**************************************************************************************
+    Function name:         display_ops(memOp ops[], int num_ops, int assoc_deg, bool print_header)
+    Input parameters:      memOp ops[]: The array of memory operations to be executed
+                           integer num_ops: The number of memory operations
+                           integer assoc_deg: The cache set association degree
+                           boolean print_header: Whether to print the table header first
+                               (only for the first batch of a trace)
+    Return value:          Void - Returns nothing
+    Purpose:               Displays the memory operations' information and result to the user
+**************************************************************************************/
+void display_ops(memOp ops[], int num_ops, int assoc_deg, bool print_header){
+    // String variable to store each memory addresses potential cache memory blocks
+    string cache_blocks;
+    // Display memory operation table header
+    if(print_header){
+        cout << "\n\nmain memory address\tmm blk #\tcm set #\tcm blk #\thit/miss" << endl;
+        cout << "-----------------------------------------------------------------------------------" << endl;
+    }
+    // Iterate through memory operations
+    for(int i=0; i < num_ops; i++){
+        // Initialize cache blocks display string to the starting cache set block number
+        cache_blocks = to_string(ops[i].cache_block_start);
+        // If the degree of association is 2, use 'or' when displaying cache blocks
+        if(assoc_deg == 2){
+            cache_blocks.append(" or " + to_string(ops[i].cache_block_start + assoc_deg - 1));
+        // Else if association degree is greater than 2, use '-' (scales better)
+        }else if(assoc_deg > 2){
+            cache_blocks.append(" - " + to_string(ops[i].cache_block_start + assoc_deg - 1));
+        }
+        // Print formatted display of memory operation information
+        printf("%8llu %20llu %15d %17s %14s\n", (unsigned long long)ops[i].mem_address, (unsigned long long)ops[i].mem_block, ops[i].cache_set,
+               cache_blocks.c_str(), result_string(ops[i].result));
+    }
+}
+/**************************************************************************************
+Function name:         tag_to_string(uint64_t tag, int num_tag_bits)
+Input parameters:      uint64_t tag: The packed tag bits
+                       Integer num_tag_bits: The number of tag bits in a main memory address
+Return value:          String tag_string: The tag string representation
+Purpose:               Creates and returns the binary string representation of a tag for display
+***************************************************************************************/
+string tag_to_string(uint64_t tag, int num_tag_bits){
+    // Start with all '0's and set the '1' characters from the most significant bit down
+    string tag_string(num_tag_bits, '0');
+    // Iterate through the tag bits
+    for(int bit=0; bit < num_tag_bits; bit++){
+        // If the current tag bit is 1, mark it in the string
+        if((tag >> bit) & 0x1)
+            tag_string[num_tag_bits - 1 - bit] = '1';
+    }
+    // Return the tag string representation
+    return tag_string;
+}
+/**************************************************************************************
+Function name:         display_cache(const cacheMemory &cache, int num_tag_bits)
+Input parameters:      cacheMemory cache: The cache memory being simulated
+                       Integer num_tag_bits: The number of tag bits in a main memory address
+Return value:          void - Returns nothing
+Purpose:               Displays the status of the system cache
+***************************************************************************************/
+void display_cache(const cacheMemory &cache, int num_tag_bits){
+    string data_string; // Variable to store the string representation of the cache data
+    string tag_string; // Variable to store the string representation of the cache tag
+    cout << "\n\nFinal \"status\" of the cache:" << endl;
+    // Display cache table header
+    cout << "Cache blk #\tdirty bit\tvalid bit\ttag\t\tData" << endl;
+    cout << "------------------------------------------------------------------------------" << endl;
+    // Iterate through the cache sets and their blocks
+    for(int cache_set=0; cache_set < cache.num_sets; cache_set++){
+        for(int way=0; way < cache.assoc_deg; way++){
+            // Global cache block number
+            int i = cache_set * cache.assoc_deg + way;
+            // Create string representation of cache data
+            data_string = cache.is_valid(cache_set, way) ? "mm blk # " + to_string(cache.block_of(cache_set, way)) : "xxx";
+            // Create string representation of the tag, all 'x's if never written
+            tag_string = cache.is_valid(cache_set, way) ? tag_to_string(cache.tags[i], num_tag_bits) : string(num_tag_bits, 'x');
+            // Display single cache block information
+            printf("%7d %14d %15d %12s %16s\n", i, cache.is_dirty(cache_set, way), cache.is_valid(cache_set, way), tag_string.c_str(), data_string.c_str());
+        }
+    }
+}
+/**************************************************************************************
+Function name:         init_cache(cacheMemory &cache, int num_sets, int assoc_deg, char replace_policy)
+Input parameters:      cacheMemory cache: The cache memory being simulated
+                       Integer num_sets: The number of cache sets
+                       Integer assoc_deg: The degree of association of the cache
+                       Character replace_policy: The replacement policy letter
+Return value:          void - Returns nothing
+Purpose:               Allocates and initializes the system cache and its replacement metadata
+**************************************************************************************/
+void init_cache(cacheMemory &cache, int num_sets, int assoc_deg, char replace_policy){
+    int num_cache_blocks = num_sets * assoc_deg; // Total number of cache blocks
+    cache.num_sets = num_sets;
+    cache.assoc_deg = assoc_deg;
+    // Every 64 ways of a cache set share one valid and one dirty mask word
+    cache.num_mask_words = (assoc_deg + 63) / 64;
+    // Initialize cache dirty and valid statuses to be false
+    cache.valid_bits.assign((size_t)num_sets * cache.num_mask_words, 0);
+    cache.dirty_bits.assign((size_t)num_sets * cache.num_mask_words, 0);
+    // Initialize the tags, ignored until valid
+    cache.tags.assign(num_cache_blocks, 0);
+    // Allocate and initialize the replacement policy's metadata
+    dispatch_policy(replace_policy, [&](auto policy){
+        decltype(policy)::init(cache);
+    });
+}
+/*
+    Paged bitmap of main memory blocks. The bits are split into pages of
+    PAGE_BITS blocks and a page is only allocated (zeroed) the first time one
+    of its blocks is set, so its memory follows the footprint of the trace
+    rather than the size of main memory, for any 64-bit block number
+
+Members:
+    Map page_slots: The slot of each allocated page, by page number (block / PAGE_BITS)
+    Vector page_nums: The page number of each slot
+    Vector words: The bitmap words of every slot, PAGE_WORDS per slot
+    Vectors recent_page_nums, recent_slots: Direct mapped cache of recently used page
+        numbers and their slots, indexed by the low page number bits (UINT64_MAX if empty),
+        so most bits are found without a lookup in page_slots
+*/
+struct pagedBitmap{
+    // Words (4 KB) and bits per page
+    static constexpr int PAGE_WORDS = 512;
+    static constexpr uint64_t PAGE_BITS = PAGE_WORDS * 64;
+    // Entries of the recently used page cache (a power of 2)
+    static constexpr int RECENT_PAGES = 1024;
+    unordered_map<uint64_t, int> page_slots;
+    vector<uint64_t> page_nums;
+    vector<uint64_t> words;
+    vector<uint64_t> recent_page_nums = vector<uint64_t>(RECENT_PAGES, UINT64_MAX);
+    vector<int> recent_slots = vector<int>(RECENT_PAGES, -1);
+
+    // Frees every page, leaving every bit clear
+    void clear(){
+        page_slots.clear();
+        page_nums.clear();
+        words.clear();
+        recent_page_nums.assign(RECENT_PAGES, UINT64_MAX);
+    }
+
+    // Returns the slot of a page, allocating the page the first time it is used
+    int page_slot(uint64_t page_num){
+        int recent = (int)(page_num & (RECENT_PAGES - 1)); // Recently used page cache entry of the page
+        if(recent_page_nums[recent] != page_num){
+            auto found = page_slots.emplace(page_num, (int)page_nums.size()); // Slot of the page
+            if(found.second){
+                page_nums.push_back(page_num);
+                words.resize(words.size() + PAGE_WORDS, 0);
+            }
+            recent_page_nums[recent] = page_num;
+            recent_slots[recent] = found.first->second;
+        }
+        return recent_slots[recent];
+    }
+
+    // Sets a bit, returns whether it was already set
+    bool test_and_set(uint64_t bit){
+        uint64_t &word = words[(size_t)page_slot(bit / PAGE_BITS) * PAGE_WORDS + (bit % PAGE_BITS) / 64]; // Word of the bit
+        uint64_t mask = 1ULL << (bit & 63); // Bit within its word
+        bool was_set = (word & mask) != 0; // Whether the bit was set before
+        word |= mask;
+        return was_set;
+    }
+
+    // Rebuilds the bitmap from saved page numbers and words, returns false if they do not fit together
+    bool restore(const vector<uint64_t> &saved_page_nums, const vector<uint64_t> &saved_words){
+        clear();
+        if(saved_words.size() != saved_page_nums.size() * PAGE_WORDS)
+            return false;
+        for(size_t slot=0; slot < saved_page_nums.size(); slot++){
+            if(saved_page_nums[slot] > UINT64_MAX / PAGE_BITS || !page_slots.emplace(saved_page_nums[slot], (int)slot).second)
+                return false; // Page past the block space or saved twice
+        }
+        page_nums = saved_page_nums;
+        words = saved_words;
+        return true;
+    }
+};
+/*
+    Hit rate statistics structure, accumulated over the batches of a trace
+
+Members:
+    Long num_ops: The number of memory operations executed
+    Long num_hits: The number of memory operations that hit in the cache (MemorySim::num_hits)
+    Long num_possible_hits: The number of memory operations to a previously seen block
+    pagedBitmap seen_blocks: The main memory blocks operated on so far, one bit per
+        block, allocated a page at a time as the trace touches new regions of memory
+    Long num_opt_hits: The number of hits with the OPT policy on the same cache (-1 if unknown)
+*/
+struct hitStats{
+    long long num_ops = 0;
+    long long num_hits = 0;
+    long long num_possible_hits = 0;
+    pagedBitmap seen_blocks;
+    long long num_opt_hits = -1;
+
+    // Marks a main memory block seen, returns whether it had been seen before
+    bool see(uint64_t mem_block){ return seen_blocks.test_and_set(mem_block); }
+};
+/**************************************************************************************
+    Function name:         tally_hit_rates(memOp ops[], int num_ops, hitStats &stats)
+    Input parameters:      memOp ops[]: The array of executed memory operations
+                           integer num_ops: The number of memory operations
+                           hitStats stats: The statistics to add the memory operations to
+    Return value:          Void - Returns nothing
+    Purpose:               Counts the optimum hits of a batch of memory operations. The actual
+                           hits are counted by the simulator kernel
+**************************************************************************************/
+void tally_hit_rates(memOp ops[], int num_ops, hitStats &stats){
+    // Iterate through memory operations
+    for(int i=0; i < num_ops; i++){
+        // Add the current main memory block to the seen blocks. If it
+        // had been seen before, the operation could have been a hit
+        if(stats.see(ops[i].mem_block)){
+            stats.num_possible_hits++; // Increment the number of possible hits
+        }
+    }
+    stats.num_ops += num_ops;
+}
+/**************************************************************************************
+    Function name:         calc_hit_rates(const hitStats &stats)
+    Input parameters:      hitStats stats: The statistics of all executed memory operations
+    Return value:          Void - Returns nothing
+    Purpose:               Calculates and displays the memory operation optimum and actual hit rates,
+                           and the OPT policy hit rate for the same cache if known
+**************************************************************************************/
+void calc_hit_rates(const hitStats &stats){
+    // Calculate and print the optimum hit rate
+    printf("\nHighest possible hit rate = %lld/%lld = %2.0f%%\n", stats.num_possible_hits, stats.num_ops, (float)stats.num_possible_hits/stats.num_ops*100.0);
+    // Calculate and print the actual cache hit rate
+    printf("Actual hit rate = %lld/%lld = %2.0f%%\n", stats.num_hits, stats.num_ops, (float)stats.num_hits/stats.num_ops*100.0);
+    // Print the best hit rate achievable by this cache (optimal replacement) if it was simulated
+    if(stats.num_opt_hits >= 0)
+        printf("Optimal (OPT) hit rate for this cache = %lld/%lld = %2.0f%%\n", stats.num_opt_hits, stats.num_ops, (float)stats.num_opt_hits/stats.num_ops*100.0);
+}
+/**************************************************************************************
+    Function name:         display_traffic(const memTraffic &traffic, int size_line)
+    Input parameters:      memTraffic traffic: The memory traffic of all executed memory operations
+                           integer size_line: The size of a line/block of memory
+    Return value:          Void - Returns nothing
+    Purpose:               Displays the bytes moved between the cache and memory
+**************************************************************************************/
+void display_traffic(const memTraffic &traffic, int size_line){
+    printf("Memory traffic: fills = %lld (%lld bytes), writebacks = %lld (%lld bytes), write-throughs = %lld (%lld bytes)\n",
+           traffic.num_fills, traffic.num_fills * size_line, traffic.num_writebacks, traffic.num_writebacks * size_line,
+           traffic.num_write_throughs, traffic.num_write_throughs * WORD_BYTES);
+    printf("Total memory traffic = %lld bytes\n", traffic.total_bytes(size_line));
+}
+
+/*
+    Online Simulator Class
+
+Simulator behind the library interface (cacheSim in memsim.h) for driving one
+simulated cache live from another program (e.g. a binary-instrumentation tool
+or an allocator hook) instead of from a trace file. Every access is decoded and
+simulated immediately with the same kernels as the trace modes. Build the file
+with MEMSIM_LIBRARY defined to leave out main() and link it into the host
+program. An instance is not thread safe; give every thread its own one
+
+Members:
+    MemorySim mem_sim: The simulator, its geometry, statistics and kernels
+    cacheMemory cache: The simulated cache
+    Vector batch: The memory operations of the batch being simulated
+    Long num_accesses: The number of accesses simulated so far
+    Boolean configured: Whether configure succeeded. Accesses are refused until it has
+*/
+class onlineSim{
+public:
+    MemorySim mem_sim;
+    cacheMemory cache;
+    vector<memOp> batch = vector<memOp>(TRACE_BATCH_SIZE);
+    long long num_accesses = 0;
+    bool configured = false;
+
+    /**********************************************************************************
+    Function name:    configure(uint64_t size_main_mem, int size_cache, int size_line, int assoc_deg,
+                                char replace_policy, bool write_back, bool write_allocate)
+    Input parameters: uint64_t size_main_mem, integers size_cache, size_line: The memory sizes in bytes
+                      Integer assoc_deg: The degree of association of the cache
+                      Character replace_policy: The replacement policy letter, any except
+                          'O' (OPT needs the future accesses)
+                      Boolean write_back, write_allocate: The write policies
+    Return value:     Boolean: Whether the configuration is valid
+    Purpose:          Sets the cache up empty, with cleared statistics
+    **********************************************************************************/
+    bool configure(uint64_t size_main_mem, int size_cache, int size_line, int assoc_deg, char replace_policy,
+                   bool write_back = true, bool write_allocate = true){
+        configured = false;
+        if(size_main_mem == 0 || size_line <= 0 || assoc_deg <= 0 || size_cache < size_line * assoc_deg ||
+           size_cache % (size_line * assoc_deg) != 0 || toupper(replace_policy) == 'O' ||
+           !valid_policy(replace_policy, assoc_deg))
+            return false;
+        mem_sim.access_clock = 0;
+        mem_sim.num_hits = 0;
+        mem_sim.traffic = memTraffic();
+        mem_sim.size_main_mem = size_main_mem;
+        mem_sim.size_cache = size_cache;
+        mem_sim.size_line = size_line;
+        mem_sim.assoc_deg = assoc_deg;
+        mem_sim.replace_policy = (char)toupper(replace_policy);
+        mem_sim.write_back = write_back;
+        mem_sim.write_allocate = write_allocate;
+        mem_sim.calc_layout();
+        init_cache(cache, size_cache / size_line / assoc_deg, assoc_deg, replace_policy);
+        num_accesses = 0;
+        configured = true;
+        return true;
+    }
+
+    /**********************************************************************************
+    Function name:    access(uint64_t mem_address, bool is_write)
+    Input parameters: uint64_t mem_address: The main memory address accessed
+                      Boolean is_write: Whether the access is a write
+    Return value:     Boolean: Whether the access hit in the cache (false, without simulating
+                      anything, if the simulator is not configured)
+    Purpose:          Simulates one access
+    **********************************************************************************/
+    bool access(uint64_t mem_address, bool is_write){
+        if(!configured)
+            return false;
+        memOp &op = batch[0]; // Operation of the access
+        op.op_type = is_write ? 'W' : 'R';
+        op.mem_address = mem_address;
+        mem_sim.decode_ops(&op, 1);
+        mem_sim.exec_ops(&op, 1, cache);
+        num_accesses++;
+        return op.result == RESULT_HIT;
+    }
+
+    /**********************************************************************************
+    Function name:    access_many(const uint64_t mem_addresses[], const bool is_writes[], int num_addresses,
+                                  uint8_t results[])
+    Input parameters: uint64_t mem_addresses[]: The main memory addresses accessed, in order
+                      Boolean is_writes[]: Whether each access is a write, or NULL if all are reads
+                      Integer num_addresses: The number of accesses
+                      uint8_t results[]: Receives each access's opResult, or NULL
+    Return value:     Long: The number of accesses that hit, or -1 if the simulator is not configured
+    Purpose:          Simulates a buffer of accesses, in batches so the per access cost
+                      is the same as the trace modes'
+    **********************************************************************************/
+    long long access_many(const uint64_t mem_addresses[], const bool is_writes[], int num_addresses, uint8_t results[] = NULL){
+        if(!configured)
+            return -1;
+        long long hits_before = mem_sim.num_hits; // Hits before the accesses
+        for(int base=0; base < num_addresses; base += TRACE_BATCH_SIZE){
+            int num_batch_ops = min(TRACE_BATCH_SIZE, num_addresses - base); // Accesses in the batch
+            for(int i=0; i < num_batch_ops; i++){
+                batch[i].op_type = (is_writes != NULL && is_writes[base + i]) ? 'W' : 'R';
+                batch[i].mem_address = mem_addresses[base + i];
+            }
+            mem_sim.decode_ops(batch.data(), num_batch_ops);
+            mem_sim.exec_ops(batch.data(), num_batch_ops, cache);
+            if(results != NULL){
+                for(int i=0; i < num_batch_ops; i++)
+                    results[base + i] = batch[i].result;
+            }
+        }
+        num_accesses += num_addresses;
+        return mem_sim.num_hits - hits_before;
+    }
+
+    // Statistics of the accesses simulated so far
+    long long num_hits() const { return mem_sim.num_hits; }
+    long long num_misses() const { return num_accesses - mem_sim.num_hits; }
+    const memTraffic &traffic() const { return mem_sim.traffic; }
+
+    // Clears the statistics, keeping the cache contents (e.g. after a warm-up)
+    void reset_stats(){
+        num_accesses = 0;
+        mem_sim.num_hits = 0;
+        mem_sim.traffic = memTraffic();
+    }
+};
+
+// Library interface (see memsim.h), forwarding to its onlineSim
+cacheSim::cacheSim() : sim(make_unique<onlineSim>()) {}
+cacheSim::~cacheSim() = default;
+cacheSim::cacheSim(cacheSim &&other) noexcept = default;
+cacheSim &cacheSim::operator=(cacheSim &&other) noexcept = default;
+bool cacheSim::configure(uint64_t size_main_mem, int size_cache, int size_line, int assoc_deg, char replace_policy,
+                         bool write_back, bool write_allocate){
+    return sim->configure(size_main_mem, size_cache, size_line, assoc_deg, replace_policy, write_back, write_allocate);
+}
+bool cacheSim::access(uint64_t mem_address, bool is_write){ return sim->access(mem_address, is_write); }
+long long cacheSim::access_many(const uint64_t mem_addresses[], const bool is_writes[], int num_addresses, uint8_t results[]){
+    return sim->access_many(mem_addresses, is_writes, num_addresses, results);
+}
+long long cacheSim::num_hits() const { return sim->num_hits(); }
+long long cacheSim::num_misses() const { return sim->num_misses(); }
+memTraffic cacheSim::traffic() const { return sim->traffic(); }
+void cacheSim::reset_stats(){ sim->reset_stats(); }
+
+/**************************************************************************************
+Function name:         thread_sim()
+Input parameters:      None
+Return value:          cacheSim: The calling thread's own simulator
+Purpose:               Per thread simulator for hooks that run on many threads, so they
+                       need no locking. Each thread must configure its instance before use
+**************************************************************************************/
+cacheSim &thread_sim(){
+    thread_local cacheSim instance; // Simulator of the calling thread
+    return instance;
+}
+
+/*
+    Sampling specification structure for approximate simulation. Set sampling
+    simulates only the cache sets whose number is a multiple of set_period.
+    Time sampling splits the trace into periods, each starting with warmup
+    references that are simulated but not counted, then window measured
+    references; the rest of the period is skipped
+
+Members:
+    Integer set_period: One in this many cache sets is simulated (1 = every set)
+    Long period: The time sampling period in references (0 = no time sampling)
+    Long warmup: The warm-up references at the start of each period
+    Long window: The measured references after each warm-up
+*/
+struct sampleSpec{
+    int set_period = 1;
+    long long period = 0;
+    long long warmup = 0;
+    long long window = 0;
+
+    // Whether any sampling is done
+    bool enabled() const { return set_period > 1 || period > 0; }
+};
+
+/*
+    Sweep configuration structure: one cache configuration of a batch mode
+    sweep and the results of simulating it
+
+Members:
+    Integer size_cache: The cache memory size in bytes
+    Integer size_line: The size of a line/block of memory
+    Integer assoc_deg: The degree of association of the cache
+    Character replace_policy: The cache replacement policy
+    Boolean write_back, write_allocate: The write policies (see MemorySim)
+    Long num_ops: The number of memory operations simulated
+    Long num_hits: The number of memory operations that hit in the cache (estimated when sampled)
+    memTraffic traffic: The memory traffic of the configuration (estimated when sampled)
+    Long num_sampled_ops: The number of measured memory operations when sampled
+    Double hit_rate_ci: The 95% confidence interval half-width of the sampled hit rate
+        (0 when not sampled, -1 if too few samples to estimate it)
+*/
+struct sweepConfig{
+    int size_cache;
+    int size_line;
+    int assoc_deg;
+    char replace_policy;
+    bool write_back = true;
+    bool write_allocate = true;
+    long long num_ops = 0;
+    long long num_hits = 0;
+    memTraffic traffic;
+    long long num_sampled_ops = 0;
+    double hit_rate_ci = 0.0;
+};
+
+/*
+    Sweep specification structure, filled from the command line and/or a
+    sweep config file. The cache sizes x line sizes x associativities x
+    policies grid is added to any explicitly listed configurations.
+
+Members:
+    String trace_filename: The trace file shared by every configuration
+    uint64_t size_main_mem: The main memory size in bytes
+    Vectors cache_sizes, line_sizes, assoc_degs, policies: The grid axes
+    Vector configs: Explicitly listed configurations
+    Integer num_threads: The number of worker threads (0 = one per core)
+    Integer num_shards: The number of threads each configuration's cache sets are split over
+    Boolean write_back, write_allocate: The write policies of every configuration
+    sampleSpec sampling: The sampling of every configuration
+    String csv_filename: The CSV file to write the results to, if any
+*/
+struct sweepSpec{
+    string trace_filename;
+    uint64_t size_main_mem = 1 << 30;
+    vector<int> cache_sizes;
+    vector<int> line_sizes;
+    vector<int> assoc_degs;
+    vector<char> policies;
+    vector<sweepConfig> configs;
+    int num_threads = 0;
+    int num_shards = 1;
+    bool write_back = true;
+    bool write_allocate = true;
+    sampleSpec sampling;
+    string csv_filename;
+};
+
+/*
+    Work Stealing Thread Pool Class
+
+Runs a fixed set of jobs on worker threads. Jobs are dealt round-robin onto
+one deque per worker; a worker takes jobs from the back of its own deque and,
+once that is empty, steals from the front of the other workers' deques, so
+long-running configurations do not leave the remaining cores idle.
+
+Members:
+    Integer num_threads: The number of worker threads
+*/
+class workStealingPool{
+public:
+    int num_threads;
+
+    workStealingPool(int threads){ num_threads = max(1, threads); } // Constructor
+
+    /**********************************************************************************
+    Function name:    run(int num_jobs, const function<void(int)> &job)
+    Input parameters: Integer num_jobs: The number of jobs, numbered 0 to num_jobs-1
+                      Function job: Runs the job with the given number
+    Return value:     Void - Returns nothing
+    Purpose:          Runs every job once across the worker threads and waits for them
+    **********************************************************************************/
+    void run(int num_jobs, const function<void(int)> &job){
+        vector<deque<int>> queues(num_threads); // Job deque of each worker
+        vector<mutex> queue_locks(num_threads); // Lock of each job deque
+        vector<thread> workers; // Worker threads
+        // Deal the jobs round-robin onto the worker deques
+        for(int i=0; i < num_jobs; i++)
+            queues[i % num_threads].push_back(i);
+
+        // Takes a job from the worker's own deque or steals one from another worker
+        auto take_job = [&](int worker, int &job_num){
+            for(int k=0; k < num_threads; k++){
+                int victim = (worker + k) % num_threads; // Deque to take from
+                lock_guard<mutex> guard(queue_locks[victim]);
+                if(queues[victim].empty())
+                    continue;
+                // Own jobs come off the back, stolen jobs off the front
+                if(k == 0){
+                    job_num = queues[victim].back();
+                    queues[victim].pop_back();
+                }else{
+                    job_num = queues[victim].front();
+                    queues[victim].pop_front();
+                }
+                return true;
+            }
+            return false; // No jobs left anywhere
+        };
+
+        // Start the workers, each running jobs until none are left
+        for(int t=0; t < num_threads; t++){
+            workers.emplace_back([&, t]{
+                int job_num;
+                while(take_job(t, job_num))
+                    job(job_num);
+            });
+        }
+        for(thread &worker : workers)
+            worker.join();
+    }
+};
+
+/**************************************************************************************
+Function name:         parse_int_list(string value, vector<int> &list)
+Input parameters:      String value: Comma separated integers, "a..b" for the powers of two
+                           from a to b (e.g. "1024..8192" = 1024,2048,4096,8192)
+                       Vector list: The list to add the integers to
+Return value:          Boolean: Whether the value was valid
+Purpose:               Parses a list of integers given for a sweep axis
+**************************************************************************************/
+bool parse_int_list(string value, vector<int> &list){
+    stringstream value_stream(value); // Stream over the comma separated items
+    string item; // Current list item
+    while(getline(value_stream, item, ',')){
+        size_t range_pos = item.find(".."); // Position of a range separator
+        int first, last; // Range bounds
+        if(range_pos == string::npos){
+            if(from_chars(item.data(), item.data() + item.size(), first).ec != errc())
+                return false;
+            list.push_back(first);
+        }else{
+            if(from_chars(item.data(), item.data() + range_pos, first).ec != errc() ||
+               from_chars(item.data() + range_pos + 2, item.data() + item.size(), last).ec != errc() || first <= 0)
+                return false;
+            // Add every doubling from first up to last
+            for(long long size = first; size <= last; size *= 2)
+                list.push_back((int)size);
+        }
+    }
+    return true;
+}
+
+/**************************************************************************************
+Function name:         parse_sweep_option(sweepSpec &spec, string key, string value)
+Input parameters:      sweepSpec spec: The sweep specification to update
+                       String key: The option name (command line flag without "--")
+                       String value: The option value
+Return value:          Boolean: Whether the option was valid
+Purpose:               Applies one sweep option. Options are:
+                           trace <file>, mem <bytes>, threads <n>, csv <file>,
+                           shards <n> (split each configuration's cache sets over n threads,
+                           for one big configuration on a large trace; at most the thread
+                           count, which then runs thread count / n configurations at a time),
+                           cache <list>, line <list>, assoc <list>, policy <L,F,O,P,S,B,R,U>,
+                           config <cache>:<line>:<assoc>:<policy> (one explicit configuration),
+                           write back|through, allocate yes|no (write policies),
+                           sample-sets <n>, sample-period <refs>, sample-warmup <refs>,
+                           sample-window <refs> (approximate results, see sampleSpec),
+                           file <sweep config file>
+**************************************************************************************/
+bool read_sweep_file(sweepSpec &spec, string filename);
+bool parse_sweep_option(sweepSpec &spec, string key, string value){
+    if(key == "trace"){
+        spec.trace_filename = value;
+    }else if(key == "mem"){
+        return from_chars(value.data(), value.data() + value.size(), spec.size_main_mem).ec == errc() && spec.size_main_mem != 0;
+    }else if(key == "threads"){
+        return from_chars(value.data(), value.data() + value.size(), spec.num_threads).ec == errc();
+    }else if(key == "shards"){
+        return from_chars(value.data(), value.data() + value.size(), spec.num_shards).ec == errc() && spec.num_shards > 0;
+    }else if(key == "csv"){
+        spec.csv_filename = value;
+    }else if(key == "cache"){
+        return parse_int_list(value, spec.cache_sizes);
+    }else if(key == "line"){
+        return parse_int_list(value, spec.line_sizes);
+    }else if(key == "assoc"){
+        return parse_int_list(value, spec.assoc_degs);
+    }else if(key == "policy"){
+        // Comma separated replacement policy letters
+        for(char policy : value){
+            if(policy != ',')
+                spec.policies.push_back((char)toupper(policy));
+        }
+    }else if(key == "config"){
+        sweepConfig config; // Explicitly listed configuration
+        if(sscanf(value.c_str(), "%d:%d:%d:%c", &config.size_cache, &config.size_line, &config.assoc_deg, &config.replace_policy) != 4)
+            return false;
+        config.replace_policy = (char)toupper(config.replace_policy);
+        spec.configs.push_back(config);
+    }else if(key == "write"){
+        if(value != "back" && value != "through")
+            return false;
+        spec.write_back = (value == "back");
+    }else if(key == "allocate"){
+        if(value != "yes" && value != "no")
+            return false;
+        spec.write_allocate = (value == "yes");
+    }else if(key == "sample-sets"){
+        return from_chars(value.data(), value.data() + value.size(), spec.sampling.set_period).ec == errc() && spec.sampling.set_period > 0;
+    }else if(key == "sample-period"){
+        return from_chars(value.data(), value.data() + value.size(), spec.sampling.period).ec == errc() && spec.sampling.period >= 0;
+    }else if(key == "sample-warmup"){
+        return from_chars(value.data(), value.data() + value.size(), spec.sampling.warmup).ec == errc() && spec.sampling.warmup >= 0;
+    }else if(key == "sample-window"){
+        return from_chars(value.data(), value.data() + value.size(), spec.sampling.window).ec == errc() && spec.sampling.window >= 0;
+    }else if(key == "file"){
+        return read_sweep_file(spec, value);
+    }else{
+        return false; // Unknown option
+    }
+    return true;
+}
+
+/**************************************************************************************
+Function name:         read_sweep_file(sweepSpec &spec, string filename)
+Input parameters:      sweepSpec spec: The sweep specification to update
+                       String filename: The sweep config file, one "key = value" option
+                           per line (see parse_sweep_option), '#' starts a comment
+Return value:          Boolean: Whether the file was read and all its options were valid
+Purpose:               Reads sweep options from a config file
+**************************************************************************************/
+bool read_sweep_file(sweepSpec &spec, string filename){
+    ifstream config_stream(filename); // Sweep config file
+    string line; // Current line of the file
+    int line_num = 0; // Current line number for error messages
+    if(!config_stream){
+        printf("---Unable to open sweep config file %s!---\n", filename.c_str());
+        return false;
+    }
+    while(getline(config_stream, line)){
+        line_num++;
+        // Strip comments and whitespace
+        line = line.substr(0, line.find('#'));
+        line.erase(remove_if(line.begin(), line.end(), ::isspace), line.end());
+        if(line.empty())
+            continue;
+        size_t equals_pos = line.find('='); // Separator of key and value
+        if(equals_pos == string::npos || !parse_sweep_option(spec, line.substr(0, equals_pos), line.substr(equals_pos + 1))){
+            printf("---Invalid sweep option on line %d of %s!---\n", line_num, filename.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+/**************************************************************************************
+Function name:         load_trace_records(string filename, traceRecords &records)
+Input parameters:      String filename: The trace file (text or binary)
+                       traceRecords records: Filled with every memory reference of the trace
+Return value:          Boolean: Whether the trace file was read
+Purpose:               Reads a whole trace into memory
+**************************************************************************************/
+bool load_trace_records(string filename, traceRecords &records){
+    traceReader trace; // Reader of the trace file
+    vector<memOp> operations(TRACE_BATCH_SIZE); // Batch of memory operations
+    int num_batch_ops; // Number of memory operations in the current batch
+    if(!trace.open_trace(filename)){
+        printf("---Unable to open input file %s!---\n", filename.c_str());
+        return false;
+    }
+    if(trace.ops_remaining > 0)
+        records.reserve(trace.ops_remaining);
+    while((num_batch_ops = trace.next_batch(operations.data(), TRACE_BATCH_SIZE)) > 0){
+        for(int i=0; i < num_batch_ops; i++)
+            records.push_back(operations[i].op_type, operations[i].mem_address);
+    }
+    return true;
+}
+
+/**************************************************************************************
+Function name:         build_next_use(const traceRecords &records, int size_line, vector<long long> &next_use)
+Input parameters:      traceRecords records: The loaded trace
+                       Integer size_line: The size of a line/block of memory
+                       Vector next_use: Filled with the index of the next reference to the same
+                           main memory block for every reference (NEVER_USED if none)
+Return value:          Void - Returns nothing
+Purpose:               Builds the next-use index of the OPT replacement policy in one backward pass
+**************************************************************************************/
+void build_next_use(const traceRecords &records, int size_line, vector<long long> &next_use){
+    unordered_map<uint64_t, long long> next_seen; // Index of the next reference to each block seen so far
+    next_use.resize(records.size());
+    // Iterate backwards through the trace
+    for(long long i=(long long)records.size() - 1; i >= 0; i--){
+        uint64_t mem_block = records.addresses[i] / size_line; // Main memory block referenced
+        auto found = next_seen.find(mem_block);
+        if(found == next_seen.end()){
+            next_use[i] = NEVER_USED; // Last reference to the block
+            next_seen.emplace(mem_block, i);
+        }else{
+            next_use[i] = found->second;
+            found->second = i;
+        }
+    }
+}
+
+/**************************************************************************************
+Function name:         shard_sets(int shard, int num_shards, int num_sets, int &first_set, int &end_set)
+Input parameters:      Integer shard: The shard number, 0 to num_shards-1
+                       Integer num_shards: The number of shards
+                       Integer num_sets: The number of cache sets
+                       Integers first_set, end_set: Set to the shard's first cache set and one past
+                           its last (equal if the shard has no sets)
+Return value:          Void - Returns nothing
+Purpose:               Splits the cache sets into contiguous ranges, one per shard. When every
+                       shard can get at least HOST_LINE_BYTES sets, range boundaries are
+                       multiples of HOST_LINE_BYTES sets: every cache array is line aligned
+                       with at least one byte per set (see lineAllocator), so no host cache
+                       line of the cache is written by two shards. Smaller caches are split
+                       set by set, which only costs some false sharing
+**************************************************************************************/
+void shard_sets(int shard, int num_shards, int num_sets, int &first_set, int &end_set){
+    int group_sets = (num_sets >= (long long)num_shards * HOST_LINE_BYTES) ? HOST_LINE_BYTES : 1; // Sets per unit of the split
+    long long num_groups = (num_sets + group_sets - 1) / group_sets; // Groups of sets
+    first_set = (int)min((long long)num_sets, num_groups * shard / num_shards * group_sets);
+    end_set = (int)min((long long)num_sets, num_groups * (shard + 1) / num_shards * group_sets);
+}
+
+// References bucketed by shard at a time by simulate_sharded (4 bytes of index each)
+const int SHARD_WINDOW_REFS = 1 << 22;
+
+/**************************************************************************************
+Function name:         simulate_sharded(MemorySim &mem_sim, cacheMemory &cache, const traceRecords &records,
+                                        const vector<long long> *next_use, int num_shards)
+Input parameters:      MemorySim mem_sim: The configuration's simulator (layout calculated)
+                       cacheMemory cache: The configuration's cache
+                       traceRecords records: The shared, read-only trace
+                       Vector next_use: The next-use index of the trace (OPT only)
+                       Integer num_shards: The number of threads to split the cache sets over
+Return value:          Void - Returns nothing
+Purpose:               Same results as simulating the trace with exec_ops, in parallel. Cache
+                       sets never interact, so every shard owns a contiguous range of sets (see
+                       shard_sets). The trace is taken SHARD_WINDOW_REFS references at a time:
+                       a pre-pass on the pool splits the window into chunks and buckets each
+                       chunk's reference indices by shard, in trace order, then every shard
+                       unpacks, decodes and simulates only the references of its buckets,
+                       chunk by chunk. Each shard runs its own clock, which only counts its
+                       references; the policies only compare clock values within a set, so
+                       every replacement decision is the same as in a sequential run. The
+                       hits and traffic of the shards are added up in shard order
+**************************************************************************************/
+void simulate_sharded(MemorySim &mem_sim, cacheMemory &cache, const traceRecords &records,
+                      const vector<long long> *next_use, int num_shards){
+    vector<memTraffic> shard_traffic(num_shards); // Memory traffic of each shard
+    vector<long long> shard_hits(num_shards, 0); // Number of hits of each shard, -1 on an invalid policy
+    vector<long long> shard_clock(num_shards, mem_sim.access_clock); // Clock value of each shard's next reference
+    vector<vector<vector<uint32_t>>> buckets(num_shards, vector<vector<uint32_t>>(num_shards)); // Window indices per chunk and shard
+    vector<int> set_shard(cache.num_sets); // Shard owning each cache set
+    workStealingPool pool(num_shards); // One worker per shard
+    for(int shard=0; shard < num_shards; shard++){
+        int first_set, end_set; // Cache sets of the shard
+        shard_sets(shard, num_shards, cache.num_sets, first_set, end_set);
+        fill(set_shard.begin() + first_set, set_shard.begin() + end_set, shard);
+    }
+    // Power of two geometries find a reference's set with shifts and a mask
+    bool pow2_geometry = is_pow2(mem_sim.size_line) && is_pow2(cache.num_sets); // Whether the set index is a bit field
+    int offset_bits = floor_log2(mem_sim.size_line); // Block offset bits of an address
+    uint64_t num_sets = cache.num_sets; // Number of cache sets
+
+    for(size_t window=0; window < records.size(); window += SHARD_WINDOW_REFS){
+        size_t num_window_refs = min((size_t)SHARD_WINDOW_REFS, records.size() - window); // References in the window
+
+        // Pre-pass: bucket the reference indices of every chunk of the window by shard
+        pool.run(num_shards, [&](int chunk){
+            size_t first = num_window_refs * chunk / num_shards; // First window index of the chunk
+            size_t end = num_window_refs * (chunk + 1) / num_shards; // One past the last
+            vector<vector<uint32_t>> &chunk_buckets = buckets[chunk]; // Buckets of the chunk
+            for(vector<uint32_t> &bucket : chunk_buckets)
+                bucket.clear();
+            for(size_t k=first; k < end; k++){
+                uint64_t mem_address = records.addresses[window + k]; // Address of the reference
+                uint64_t cache_set = pow2_geometry ? (mem_address >> offset_bits) & (num_sets - 1)
+                                                   : mem_address / mem_sim.size_line % num_sets;
+                chunk_buckets[set_shard[cache_set]].push_back((uint32_t)k);
+            }
+        });
+
+        // Simulate every shard's references, in trace order
+        pool.run(num_shards, [&](int shard){
+            if(shard_hits[shard] < 0)
+                return;
+            vector<memOp> operations(TRACE_BATCH_SIZE); // Batch of memory operations private to the shard
+            int num_batch_ops = 0; // Operations in the batch
+            // Decodes and simulates the gathered batch
+            auto run_batch = [&](){
+                mem_sim.decode_ops(operations.data(), num_batch_ops);
+                long long batch_hits = (mem_sim.*mem_sim.exec_kernel)(mem_sim.replace_policy, operations.data(), NULL, num_batch_ops,
+                                                                      cache, shard_clock[shard], shard_traffic[shard]);
+                shard_hits[shard] = (batch_hits < 0) ? -1 : shard_hits[shard] + batch_hits;
+                shard_clock[shard] += num_batch_ops;
+                num_batch_ops = 0;
+            };
+            for(int chunk=0; chunk < num_shards && shard_hits[shard] >= 0; chunk++){
+                for(uint32_t k : buckets[chunk][shard]){
+                    records.unpack(window + k, 1, &operations[num_batch_ops]);
+                    if(next_use != NULL)
+                        operations[num_batch_ops].next_use = (*next_use)[window + k];
+                    if(++num_batch_ops == TRACE_BATCH_SIZE)
+                        run_batch();
+                }
+            }
+            if(num_batch_ops > 0 && shard_hits[shard] >= 0)
+                run_batch();
+        });
+    }
+
+    for(int shard=0; shard < num_shards; shard++){
+        if(shard_hits[shard] < 0){
+            printf("---Invalid replacement policy!---\n");
+            break;
+        }
+        mem_sim.traffic.add(shard_traffic[shard]);
+        mem_sim.num_hits += shard_hits[shard];
+    }
+    mem_sim.access_clock += records.size(); // Advance the simulator clock past the trace
+}
+
+/**************************************************************************************
+Function name:         simulate_config(sweepConfig &config, uint64_t size_main_mem, const traceRecords &records,
+                                       const vector<long long> *next_use, int num_shards,
+                                       const sampleSpec *sampling)
+Input parameters:      sweepConfig config: The cache configuration to simulate, receives the results
+                       uint64_t size_main_mem: The main memory size in bytes
+                       traceRecords records: The shared, read-only trace
+                       Vector next_use: The next-use index of the trace for the configuration's
+                           line size (see build_next_use), only needed for the OPT policy
+                       Integer num_shards: The number of threads to split the cache sets over
+                       sampleSpec sampling: The sampling to apply, or NULL to simulate everything
+Return value:          Void - Returns nothing
+Purpose:               Simulates the whole trace on one cache configuration, or estimates
+                       its results from a sample (see simulate_sampled)
+**************************************************************************************/
+void simulate_sampled(sweepConfig &config, MemorySim &mem_sim, cacheMemory &cache, const traceRecords &records,
+                      const vector<long long> *next_use, const sampleSpec &sampling);
+void simulate_config(sweepConfig &config, uint64_t size_main_mem, const traceRecords &records,
+                     const vector<long long> *next_use, int num_shards, const sampleSpec *sampling = NULL){
+    MemorySim mem_sim = MemorySim(); // Simulator of this configuration
+    mem_sim.size_main_mem = size_main_mem;
+    mem_sim.size_cache = config.size_cache;
+    mem_sim.size_line = config.size_line;
+    mem_sim.assoc_deg = config.assoc_deg;
+    mem_sim.replace_policy = config.replace_policy;
+    mem_sim.write_back = config.write_back;
+    mem_sim.write_allocate = config.write_allocate;
+    mem_sim.calc_layout();
+
+    cacheMemory cache; // Cache of this configuration
+    init_cache(cache, config.size_cache / config.size_line / config.assoc_deg, config.assoc_deg, config.replace_policy);
+    // Sampled runs are estimated separately (and are cheap enough not to shard)
+    if(sampling != NULL && sampling->enabled()){
+        simulate_sampled(config, mem_sim, cache, records, next_use, *sampling);
+        return;
+    }
+    if(num_shards > 1){
+        simulate_sharded(mem_sim, cache, records, next_use, num_shards);
+    }else{
+        // Batch of memory operations private to this configuration
+        vector<memOp> operations(TRACE_BATCH_SIZE);
+
+        // Simulate the shared trace one batch at a time
+        for(size_t base=0; base < records.size(); base += TRACE_BATCH_SIZE){
+            int num_batch_ops = (int)min((size_t)TRACE_BATCH_SIZE, records.size() - base);
+            records.unpack(base, num_batch_ops, operations.data());
+            mem_sim.decode_ops(operations.data(), num_batch_ops);
+            if(next_use != NULL){
+                for(int i=0; i < num_batch_ops; i++)
+                    operations[i].next_use = (*next_use)[base + i];
+            }
+            mem_sim.exec_ops(operations.data(), num_batch_ops, cache);
+        }
+    }
+    config.num_ops = records.size();
+    config.num_hits = mem_sim.num_hits;
+    config.traffic = mem_sim.traffic;
+}
+
+/**************************************************************************************
+Function name:         ratio_confidence(const vector<long long> &hits, const vector<long long> &accesses,
+                                        double sampled_fraction)
+Input parameters:      Vectors hits, accesses: The hits and accesses of every sample unit
+                       Double sampled_fraction: The fraction of all units that were sampled
+Return value:          Double: The 95% confidence interval half-width of the hit rate, or -1
+                       with fewer than two units
+Purpose:               Confidence interval of a ratio estimate (total hits / total accesses)
+                       from cluster samples, using the linearized variance of the ratio with
+                       the finite population correction
+**************************************************************************************/
+double ratio_confidence(const vector<long long> &hits, const vector<long long> &accesses, double sampled_fraction){
+    int num_units = (int)hits.size(); // Number of sample units
+    double total_hits = 0.0, total_accesses = 0.0; // Totals over the units
+    for(int k=0; k < num_units; k++){
+        total_hits += hits[k];
+        total_accesses += accesses[k];
+    }
+    if(num_units < 2 || total_accesses == 0.0)
+        return -1.0;
+    double ratio = total_hits / total_accesses; // Estimated hit rate
+    double mean_accesses = total_accesses / num_units; // Mean accesses per unit
+    double residual_sum = 0.0; // Sum of squared residuals of the units around the ratio
+    for(int k=0; k < num_units; k++){
+        double residual = hits[k] - ratio * accesses[k];
+        residual_sum += residual * residual;
+    }
+    double variance = residual_sum / (num_units - 1) / (num_units * mean_accesses * mean_accesses) *
+                      max(0.0, 1.0 - sampled_fraction); // Variance of the ratio estimate
+    return 1.96 * sqrt(variance);
+}
+
+/**************************************************************************************
+Function name:         simulate_sampled(sweepConfig &config, MemorySim &mem_sim, cacheMemory &cache,
+                                        const traceRecords &records, const vector<long long> *next_use,
+                                        const sampleSpec &sampling)
+Input parameters:      sweepConfig config: The cache configuration, receives the estimated results
+                       MemorySim mem_sim: The configuration's simulator (layout calculated)
+                       cacheMemory cache: The configuration's empty cache
+                       traceRecords records: The shared, read-only trace
+                       Vector next_use: The next-use index of the trace (OPT only)
+                       sampleSpec sampling: The set and/or time sampling to apply
+Return value:          Void - Returns nothing
+Purpose:               Estimates the hit rate of a configuration from sampled cache sets and/or
+                       sampled time windows. Operations keep their trace clock values, so the
+                       sampled sets behave exactly as in a full run. The confidence interval
+                       treats each time window (with time sampling) or each sampled cache set
+                       (set sampling only) as one sample unit
+**************************************************************************************/
+void simulate_sampled(sweepConfig &config, MemorySim &mem_sim, cacheMemory &cache, const traceRecords &records,
+                      const vector<long long> *next_use, const sampleSpec &sampling){
+    long long num_records = (long long)records.size(); // Number of references in the trace
+    int set_period = min(sampling.set_period, cache.num_sets); // One in this many sets is simulated
+    long long period = sampling.period > 0 ? sampling.period : max(1LL, num_records); // Time sampling period
+    long long warmup = sampling.period > 0 ? sampling.warmup : 0; // Warm-up references per period
+    long long window = sampling.period > 0 ? sampling.window : num_records; // Measured references per period
+    vector<memOp> operations(TRACE_BATCH_SIZE); // Batch of memory operations
+    vector<int> order(TRACE_BATCH_SIZE); // Batch indices of the operations in sampled sets
+    setCounters set_counters; // Per set counters of the measured operations
+    vector<long long> unit_hits, unit_accesses; // Hits and accesses of every time window
+    long long num_measured = 0; // Number of measured operations
+    memTraffic measured_traffic; // Memory traffic of the measured operations
+    set_counters.init(cache.num_sets);
+
+    // Simulates the sampled sets of trace references [first, last), returns the number simulated
+    auto simulate_range = [&](long long first, long long last){
+        long long num_simulated = 0; // Number of operations in sampled sets
+        for(long long base=first; base < last; base += TRACE_BATCH_SIZE){
+            int num_batch_ops = (int)min((long long)TRACE_BATCH_SIZE, last - base); // Operations in the batch
+            int num_order = 0; // Operations of the batch in sampled sets
+            records.unpack(base, num_batch_ops, operations.data());
+            mem_sim.decode_ops(operations.data(), num_batch_ops);
+            for(int i=0; i < num_batch_ops; i++){
+                if(operations[i].cache_set % set_period != 0)
+                    continue;
+                if(next_use != NULL)
+                    operations[i].next_use = (*next_use)[base + i];
+                order[num_order++] = i;
+            }
+            mem_sim.access_clock = base; // Skipped references still advance the clock
+            mem_sim.exec_ops_subset(operations.data(), num_batch_ops, order.data(), num_order, cache);
+            num_simulated += num_order;
+        }
+        return num_simulated;
+    };
+
+    // Every period: warm up without counting, then measure one window
+    for(long long start=0; start < num_records; start += period){
+        long long warm_end = min(start + warmup, num_records); // End of the warm-up
+        long long window_end = min(warm_end + window, num_records); // End of the measured window
+        simulate_range(start, warm_end);
+        long long hits_before = mem_sim.num_hits; // Hits before the window
+        memTraffic traffic_before = mem_sim.traffic; // Traffic before the window
+        mem_sim.set_counters = &set_counters;
+        long long num_window_ops = simulate_range(warm_end, window_end); // Measured operations of the window
+        mem_sim.set_counters = NULL;
+        unit_hits.push_back(mem_sim.num_hits - hits_before);
+        unit_accesses.push_back(num_window_ops);
+        num_measured += num_window_ops;
+        measured_traffic.num_fills += mem_sim.traffic.num_fills - traffic_before.num_fills;
+        measured_traffic.num_writebacks += mem_sim.traffic.num_writebacks - traffic_before.num_writebacks;
+        measured_traffic.num_write_throughs += mem_sim.traffic.num_write_throughs - traffic_before.num_write_throughs;
+    }
+
+    // Without time sampling the sampled cache sets are the sample units
+    double sampled_fraction; // Fraction of all sample units that were measured
+    if(sampling.period > 0){
+        sampled_fraction = 0.0; // Windows are a small sample of all possible windows
+    }else{
+        unit_hits.clear();
+        unit_accesses.clear();
+        for(int set_num=0; set_num < cache.num_sets; set_num += set_period){
+            if(set_counters.accesses[set_num] == 0)
+                continue;
+            unit_hits.push_back(set_counters.accesses[set_num] - set_counters.misses[set_num]);
+            unit_accesses.push_back(set_counters.accesses[set_num]);
+        }
+        sampled_fraction = 1.0 / set_period;
+    }
+
+    // Scale the measured results up to the whole trace
+    double scale = num_measured ? (double)num_records / num_measured : 0.0; // Trace references per measured one
+    long long total_hits = 0; // Measured hits
+    for(long long hits : unit_hits)
+        total_hits += hits;
+    config.num_ops = num_records;
+    config.num_sampled_ops = num_measured;
+    config.num_hits = llround(total_hits * scale);
+    config.traffic.num_fills = llround(measured_traffic.num_fills * scale);
+    config.traffic.num_writebacks = llround(measured_traffic.num_writebacks * scale);
+    config.traffic.num_write_throughs = llround(measured_traffic.num_write_throughs * scale);
+    config.hit_rate_ci = ratio_confidence(unit_hits, unit_accesses, sampled_fraction);
+}
+
+/**************************************************************************************
+Function name:         run_sweep(int argc, char *argv[])
+Input parameters:      Integer argc, argv: The command line, "--sweep" followed by
+                           "--<option> <value>" pairs (see parse_sweep_option)
+Return value:          Integer: The program exit status
+Purpose:               Batch mode. Simulates every configuration of the sweep against
+                       one shared copy of the trace on a work-stealing thread pool and
+                       prints a summary table (and optionally writes a CSV file)
+**************************************************************************************/
+int run_sweep(int argc, char *argv[]){
+    sweepSpec spec; // Sweep specification
+    traceRecords records; // Shared, read-only trace
+
+    // Parse the "--option value" pairs of the command line
+    for(int i=2; i < argc; i += 2){
+        string key = argv[i]; // Option name
+        if(key.rfind("--", 0) != 0 || i + 1 >= argc || !parse_sweep_option(spec, key.substr(2), argv[i + 1])){
+            printf("---Invalid sweep option %s!---\n", key.c_str());
+            return 1;
+        }
+    }
+
+    // Add the cartesian grid to the explicitly listed configurations
+    for(int size_cache : spec.cache_sizes)
+        for(int size_line : spec.line_sizes)
+            for(int assoc_deg : spec.assoc_degs)
+                for(char policy : spec.policies){
+                    sweepConfig config;
+                    config.size_cache = size_cache;
+                    config.size_line = size_line;
+                    config.assoc_deg = assoc_deg;
+                    config.replace_policy = policy;
+                    spec.configs.push_back(config);
+                }
+
+    // Drop configurations that do not describe a whole number of cache sets
+    vector<sweepConfig> configs; // Valid configurations to simulate
+    for(sweepConfig &config : spec.configs){
+        if(config.size_line <= 0 || config.assoc_deg <= 0 || config.size_cache < config.size_line * config.assoc_deg ||
+           config.size_cache % (config.size_line * config.assoc_deg) != 0 ||
+           !valid_policy(config.replace_policy, config.assoc_deg)){
+            printf("---Skipping invalid configuration %d:%d:%d:%c!---\n", config.size_cache, config.size_line, config.assoc_deg, config.replace_policy);
+            continue;
+        }
+        config.write_back = spec.write_back;
+        config.write_allocate = spec.write_allocate;
+        configs.push_back(config);
+    }
+    if(spec.trace_filename.empty() || configs.empty()){
+        printf("---A sweep needs --trace and at least one cache configuration!---\n");
+        return 1;
+    }
+    if(spec.sampling.period > 0 && (spec.sampling.window == 0 || spec.sampling.warmup + spec.sampling.window > spec.sampling.period)){
+        printf("---Time sampling needs 0 < warm-up + window <= period!---\n");
+        return 1;
+    }
+
+    // Read the trace once, every configuration simulates the same copy
+    if(!load_trace_records(spec.trace_filename, records))
+        return 1;
+    // Build the OPT next-use index once per line size that has OPT configurations
+    map<int, vector<long long>> next_uses; // Next-use index of each line size
+    for(sweepConfig &config : configs){
+        if(config.replace_policy == 'O' && next_uses.find(config.size_line) == next_uses.end())
+            build_next_use(records, config.size_line, next_uses[config.size_line]);
+    }
+
+    // Simulate every configuration on the thread pool. Each configuration runs num_shards
+    // threads of its own, so shards * configuration workers stays within the thread count
+    int num_threads = max(1, spec.num_threads > 0 ? spec.num_threads : (int)thread::hardware_concurrency());
+    spec.num_shards = min(spec.num_shards, num_threads);
+    workStealingPool pool(min(num_threads / spec.num_shards, (int)configs.size()));
+    pool.run((int)configs.size(), [&](int job){
+        // Only OPT configurations look up their line size's next-use index
+        const vector<long long>* next_use = NULL;
+        if(configs[job].replace_policy == 'O')
+            next_use = &next_uses.at(configs[job].size_line);
+        simulate_config(configs[job], spec.size_main_mem, records, next_use, spec.num_shards, &spec.sampling);
+    });
+
+    // Print the summary table
+    printf("\nWrite policy: %s, %s\n", spec.write_back ? "write-back" : "write-through", spec.write_allocate ? "write-allocate" : "no-write-allocate");
+    if(spec.sampling.enabled())
+        printf("Sampling: 1 in %d sets, %lld warm-up + %lld measured references every %lld (estimated results)\n", spec.sampling.set_period,
+               spec.sampling.warmup, spec.sampling.window, spec.sampling.period);
+    printf("\n%12s %10s %8s %8s %14s %14s %10s %14s %14s %14s\n", "cache size", "line size", "assoc", "policy", "hits", "misses", "hit rate",
+           "fill bytes", "writeback B", "write-thru B");
+    cout << "------------------------------------------------------------------------------------------------------------------------------" << endl;
+    for(sweepConfig &config : configs){
+        printf("%12d %10d %8d %8c %14lld %14lld %9.2f%% %14lld %14lld %14lld\n", config.size_cache, config.size_line, config.assoc_deg, config.replace_policy,
+               config.num_hits, config.num_ops - config.num_hits, (double)config.num_hits / config.num_ops * 100.0,
+               config.traffic.num_fills * config.size_line, config.traffic.num_writebacks * config.size_line,
+               config.traffic.num_write_throughs * WORD_BYTES);
+        // Confidence interval of the estimated hit rate
+        if(spec.sampling.enabled()){
+            if(config.hit_rate_ci >= 0.0)
+                printf("%67s +/- %.2f%% from %lld sampled references\n", "", config.hit_rate_ci * 100.0, config.num_sampled_ops);
+            else
+                printf("%67s (too few samples for a confidence interval, %lld sampled references)\n", "", config.num_sampled_ops);
+        }
+    }
+
+    // Write the results as CSV if requested
+    if(!spec.csv_filename.empty()){
+        FILE* csv_file = fopen(spec.csv_filename.c_str(), "w");
+        if(csv_file == NULL){
+            printf("---Unable to open CSV file %s!---\n", spec.csv_filename.c_str());
+            return 1;
+        }
+        fprintf(csv_file, "cache_size,line_size,assoc,policy,write_back,write_allocate,num_ops,hits,misses,hit_rate,"
+                          "fills,writebacks,write_throughs,fill_bytes,writeback_bytes,write_through_bytes,total_bytes,"
+                          "sampled_ops,hit_rate_ci\n");
+        for(sweepConfig &config : configs){
+            const memTraffic &traffic = config.traffic; // Memory traffic of the configuration
+            fprintf(csv_file, "%d,%d,%d,%c,%d,%d,%lld,%lld,%lld,%.6f,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%.6f\n", config.size_cache, config.size_line,
+                    config.assoc_deg, config.replace_policy, config.write_back, config.write_allocate, config.num_ops, config.num_hits,
+                    config.num_ops - config.num_hits, (double)config.num_hits / config.num_ops, traffic.num_fills, traffic.num_writebacks,
+                    traffic.num_write_throughs, traffic.num_fills * config.size_line, traffic.num_writebacks * config.size_line,
+                    traffic.num_write_throughs * WORD_BYTES, traffic.total_bytes(config.size_line),
+                    spec.sampling.enabled() ? config.num_sampled_ops : config.num_ops, config.hit_rate_ci);
+        }
+        fclose(csv_file);
+    }
+    return 0;
+}
+
+/*
+    Stack Distance Class
+
+Single-pass Mattson stack distance engine for one line size and number of
+cache sets. The stack distance of a reference is the number of distinct
+blocks of its cache set referenced since the last reference to its block; the
+reference hits in an LRU cache of this geometry exactly when the
+associativity is larger than that distance, so one pass over the trace gives
+the LRU hit rate of every associativity (and, with one set, of every fully
+associative cache size).
+
+Each cache set numbers its references with a local clock. A Fenwick tree
+over those clock values holds a 1 at the last reference time of every block
+in the set, so a distance is a range sum and each reference costs O(log n).
+When a set's clock reaches the tree capacity, the live blocks are renumbered
+1..n so memory stays proportional to the number of distinct blocks.
+
+Members:
+    Integer size_line: The size of a line/block of memory
+    Integer num_sets: The number of cache sets
+    Vector hist: hist[d] = number of references with stack distance d
+    Long num_cold: The number of first references to a block (compulsory misses)
+    Long num_ops: The number of references
+*/
+class stackDistance{
+public:
+    int size_line;
+    int num_sets;
+    vector<long long> hist;
+    long long num_cold;
+    long long num_ops;
+
+    stackDistance(int line, int sets){ // Constructor
+        size_line = line;
+        num_sets = sets;
+        num_cold = 0;
+        num_ops = 0;
+        set_state.resize(sets);
+    }
+
+    /**********************************************************************************
+    Function name:    access(uint64_t mem_address)
+    Input parameters: uint64_t mem_address: The main memory address referenced
+    Return value:     Integer: The stack distance, or -1 for a first reference
+    Purpose:          Records the stack distance of one memory reference
+    **********************************************************************************/
+    int access(uint64_t mem_address){
+        uint64_t mem_block = mem_address / size_line; // Main memory block referenced
+        setState &state = set_state[mem_block % num_sets]; // Stack state of the block's cache set
+        num_ops++;
+
+        // Make room for the next clock value if the tree is full
+        if(state.next_time >= (int)state.tree.size())
+            compact(state);
+        int now = state.next_time++; // Local clock value of this reference
+
+        auto found = last_time.find(mem_block); // Last reference to the block, if any
+        int distance = -1; // Stack distance of the reference
+        if(found == last_time.end()){
+            num_cold++; // First reference to the block
+            last_time.emplace(mem_block, now);
+        }else{
+            int prev = found->second; // Local clock value of the last reference
+            // Distinct blocks referenced since = markers strictly between prev and now
+            distance = prefix_sum(state, now - 1) - prefix_sum(state, prev);
+            if(distance >= (int)hist.size())
+                hist.resize(distance + 1, 0);
+            hist[distance]++;
+            // Move the block's marker to the current time
+            add(state, prev, -1);
+            state.owner[prev] = NO_BLOCK;
+            found->second = now;
+        }
+        add(state, now, 1);
+        state.owner[now] = mem_block;
+        return distance;
+    }
+
+    /**********************************************************************************
+    Function name:    hits(int assoc_deg)
+    Input parameters: Integer assoc_deg: The degree of association of the cache
+    Return value:     Long: The number of references that hit in an LRU cache
+    Purpose:          Returns the LRU hit count of this geometry with the given associativity
+    **********************************************************************************/
+    long long hits(int assoc_deg) const {
+        long long num_hits = 0; // Number of references with a distance below assoc_deg
+        for(int d=0; d < assoc_deg && d < (int)hist.size(); d++)
+            num_hits += hist[d];
+        return num_hits;
+    }
+
+private:
+    static constexpr uint64_t NO_BLOCK = ~0ULL; // Owner of a clock value with no marker
+    static constexpr int MIN_TREE_SIZE = 64; // Smallest Fenwick tree allocated per set
+
+    /*
+        Stack state of one cache set
+    Members:
+        Vector tree: Fenwick tree over local clock values (index 0 unused)
+        Vector owner: The block whose last reference has each clock value
+        Integer next_time: The next local clock value (starts at 1)
+    */
+    struct setState{
+        vector<int> tree;
+        vector<uint64_t> owner;
+        int next_time = 1;
+    };
+    vector<setState> set_state; // Stack state of every cache set
+    unordered_map<uint64_t, int> last_time; // Local clock value of each block's last reference
+
+    // Fenwick tree point update and prefix sum over clock values 1..time
+    static void add(setState &state, int time, int delta){
+        for(; time < (int)state.tree.size(); time += time & -time)
+            state.tree[time] += delta;
+    }
+    static int prefix_sum(const setState &state, int time){
+        int sum = 0;
+        for(; time > 0; time -= time & -time)
+            sum += state.tree[time];
+        return sum;
+    }
+
+    // Renumbers the live blocks of a set 1..n in reference order and rebuilds its tree
+    void compact(setState &state){
+        vector<uint64_t> live; // Live blocks in order of their last reference
+        for(int time=1; time < state.next_time; time++){
+            if(state.owner.size() > (size_t)time && state.owner[time] != NO_BLOCK)
+                live.push_back(state.owner[time]);
+        }
+        // Leave room for at least as many new references as there are live blocks
+        int size = max(MIN_TREE_SIZE, 2 * (int)live.size() + 2);
+        state.tree.assign(size, 0);
+        state.owner.assign(size, NO_BLOCK);
+        for(int i=0; i < (int)live.size(); i++){
+            state.owner[i + 1] = live[i];
+            last_time[live[i]] = i + 1;
+            state.tree[i + 1] = 1;
+        }
+        // Linear time Fenwick tree construction from the marker array
+        for(int time=1; time < size; time++){
+            int parent = time + (time & -time);
+            if(parent < size)
+                state.tree[parent] += state.tree[time];
+        }
+        state.next_time = (int)live.size() + 1;
+    }
+};
+
+/**************************************************************************************
+Function name:         run_stack_distance(int argc, char *argv[])
+Input parameters:      Integer argc, argv: The command line, "--stackdist" followed by
+                           "--<option> <value>" pairs: --trace <file>, --line <list>,
+                           --sets <list> (default 1, fully associative), --csv <file>
+Return value:          Integer: The program exit status
+Purpose:               Computes the LRU miss-ratio curve of every line size, set count and
+                       power-of-two associativity in a single pass over the trace and
+                       writes it as CSV (to the CSV file or to the screen)
+**************************************************************************************/
+int run_stack_distance(int argc, char *argv[]){
+    string trace_filename; // Trace file to analyze
+    string csv_filename; // CSV file to write, empty for the screen
+    vector<int> line_sizes; // Line sizes to analyze
+    vector<int> set_counts; // Numbers of cache sets to analyze
+    vector<stackDistance> engines; // One engine per line size and set count
+
+    // Parse the "--option value" pairs of the command line
+    for(int i=2; i < argc; i += 2){
+        string key = argv[i]; // Option name
+        bool valid = i + 1 < argc; // Whether the option is valid
+        if(valid && key == "--trace")
+            trace_filename = argv[i + 1];
+        else if(valid && key == "--csv")
+            csv_filename = argv[i + 1];
+        else if(valid && key == "--line")
+            valid = parse_int_list(argv[i + 1], line_sizes);
+        else if(valid && key == "--sets")
+            valid = parse_int_list(argv[i + 1], set_counts);
+        else
+            valid = false;
+        if(!valid){
+            printf("---Invalid stack distance option %s!---\n", key.c_str());
+            return 1;
+        }
+    }
+    if(set_counts.empty())
+        set_counts.push_back(1);
+    if(trace_filename.empty() || line_sizes.empty()){
+        printf("---Stack distance analysis needs --trace and --line!---\n");
+        return 1;
+    }
+    for(int size_line : line_sizes)
+        for(int num_sets : set_counts){
+            if(size_line <= 0 || num_sets <= 0){
+                printf("---Invalid line size %d or set count %d!---\n", size_line, num_sets);
+                return 1;
+            }
+            engines.push_back(stackDistance(size_line, num_sets));
+        }
+
+    // Stream the trace once, feeding every reference to every engine
+    traceReader trace; // Reader of the trace file
+    vector<memOp> operations(TRACE_BATCH_SIZE); // Batch of memory operations
+    int num_batch_ops; // Number of memory operations in the current batch
+    if(!trace.open_trace(trace_filename)){
+        printf("---Unable to open input file %s!---\n", trace_filename.c_str());
+        return 1;
+    }
+    while((num_batch_ops = trace.next_batch(operations.data(), TRACE_BATCH_SIZE)) > 0){
+        for(stackDistance &engine : engines)
+            for(int i=0; i < num_batch_ops; i++)
+                engine.access((uint64_t)operations[i].mem_address);
+    }
+
+    // Write the miss-ratio curve of every engine
+    FILE* csv_file = csv_filename.empty() ? stdout : fopen(csv_filename.c_str(), "w");
+    if(csv_file == NULL){
+        printf("---Unable to open CSV file %s!---\n", csv_filename.c_str());
+        return 1;
+    }
+    fprintf(csv_file, "line_size,num_sets,assoc,cache_size,num_ops,hits,misses,hit_rate,miss_ratio\n");
+    for(stackDistance &engine : engines){
+        // Associativities double until every reuse fits (the rest of the curve is flat)
+        for(long long assoc_deg=1; ; assoc_deg *= 2){
+            long long num_hits = engine.hits((int)min(assoc_deg, (long long)INT32_MAX));
+            fprintf(csv_file, "%d,%d,%lld,%lld,%lld,%lld,%lld,%.6f,%.6f\n", engine.size_line, engine.num_sets, assoc_deg,
+                    assoc_deg * engine.num_sets * engine.size_line, engine.num_ops, num_hits, engine.num_ops - num_hits,
+                    (double)num_hits / engine.num_ops, (double)(engine.num_ops - num_hits) / engine.num_ops);
+            if(assoc_deg >= (long long)engine.hist.size())
+                break;
+        }
+    }
+    if(csv_file != stdout)
+        fclose(csv_file);
+    return 0;
+}
+
+/*
+    Miss Classifier Class
+
+Classifies every miss of a simulated cache as compulsory, capacity or
+conflict (the 3C model) with a fully associative LRU shadow cache of the
+same capacity, run alongside exec_ops on the executed batches:
+    compulsory: first reference to the block
+    capacity: the shadow cache misses too, only more capacity would help
+    conflict: the shadow cache hits, more associativity would help
+The shadow cache is a one-set stackDistance engine (a reference hits in it
+when its stack distance is below the number of cache blocks), which also
+gives the reuse distance histogram of the trace.
+
+Members:
+    stackDistance shadow: The fully associative LRU shadow cache
+    Integer num_blocks: The number of cache blocks of the simulated cache
+    Long num_compulsory, num_capacity, num_conflict: The classified misses
+*/
+class missClassifier{
+public:
+    stackDistance shadow;
+    int num_blocks;
+    long long num_compulsory = 0;
+    long long num_capacity = 0;
+    long long num_conflict = 0;
+
+    missClassifier(int size_cache, int size_line) : shadow(size_line, 1){ num_blocks = size_cache / size_line; } // Constructor
+
+    // Classifies the misses of a batch of executed memory operations
+    void classify_ops(const memOp ops[], int num_ops){
+        for(int i=0; i < num_ops; i++){
+            int distance = shadow.access((uint64_t)ops[i].mem_address); // Fully associative LRU stack distance
+            if(ops[i].result != RESULT_MISS)
+                continue;
+            if(distance < 0)
+                num_compulsory++;
+            else if(distance >= num_blocks)
+                num_capacity++;
+            else
+                num_conflict++;
+        }
+    }
+
+    /**********************************************************************************
+    Function name:    report(const setCounters &counters)
+    Input parameters: setCounters counters: The per cache set counters of the simulation
+    Return value:     Void - Returns nothing
+    Purpose:          Displays the 3C miss breakdown and the sets with the most misses
+    **********************************************************************************/
+    void report(const setCounters &counters) const {
+        long long num_misses = num_compulsory + num_capacity + num_conflict; // Total misses
+        vector<int> hot_sets(counters.misses.size()); // Cache sets, most misses first
+        printf("\nMiss classification (3C):\n");
+        printf("Compulsory misses = %lld (%.2f%%)\n", num_compulsory, num_misses ? (double)num_compulsory / num_misses * 100.0 : 0.0);
+        printf("Capacity misses = %lld (%.2f%%), more capacity would remove these\n", num_capacity,
+               num_misses ? (double)num_capacity / num_misses * 100.0 : 0.0);
+        printf("Conflict misses = %lld (%.2f%%), more associativity would remove these\n", num_conflict,
+               num_misses ? (double)num_conflict / num_misses * 100.0 : 0.0);
+        for(size_t set_num=0; set_num < hot_sets.size(); set_num++)
+            hot_sets[set_num] = (int)set_num;
+        int num_hot = min((int)hot_sets.size(), 5); // Number of hot sets shown
+        partial_sort(hot_sets.begin(), hot_sets.begin() + num_hot, hot_sets.end(),
+                     [&](int a, int b){ return counters.misses[a] > counters.misses[b]; });
+        printf("Sets with the most misses:");
+        for(int k=0; k < num_hot; k++)
+            printf(" %d (%lld/%lld)", hot_sets[k], counters.misses[hot_sets[k]], counters.accesses[hot_sets[k]]);
+        printf("\n");
+    }
+
+    /**********************************************************************************
+    Function name:    write_csv(string prefix, const setCounters &counters)
+    Input parameters: String prefix: Prefix of the CSV file names
+                      setCounters counters: The per cache set counters of the simulation
+    Return value:     Boolean: Whether both files were written
+    Purpose:          Writes <prefix>_sets.csv with the per set counters and
+                      <prefix>_reuse.csv with the reuse distance histogram in power of two
+                      buckets (distance -1 = first reference) and the fully associative
+                      LRU hit rate of a cache holding just above each bucket's distances
+    **********************************************************************************/
+    bool write_csv(string prefix, const setCounters &counters) const {
+        FILE* sets_file = fopen((prefix + "_sets.csv").c_str(), "w");
+        FILE* reuse_file = fopen((prefix + "_reuse.csv").c_str(), "w");
+        if(sets_file == NULL || reuse_file == NULL){
+            printf("---Unable to open CSV files %s_*.csv!---\n", prefix.c_str());
+            if(sets_file != NULL)
+                fclose(sets_file);
+            if(reuse_file != NULL)
+                fclose(reuse_file);
+            return false;
+        }
+        fprintf(sets_file, "set,accesses,misses,evictions,dirty_evictions,miss_rate\n");
+        for(size_t set_num=0; set_num < counters.accesses.size(); set_num++){
+            fprintf(sets_file, "%zu,%lld,%lld,%lld,%lld,%.6f\n", set_num, counters.accesses[set_num], counters.misses[set_num],
+                    counters.evictions[set_num], counters.dirty_evictions[set_num],
+                    counters.accesses[set_num] ? (double)counters.misses[set_num] / counters.accesses[set_num] : 0.0);
+        }
+        fprintf(reuse_file, "distance_min,distance_max,count,fa_lru_hit_rate\n");
+        fprintf(reuse_file, "-1,-1,%lld,0.000000\n", shadow.num_cold);
+        long long num_reused = 0; // References with a distance up to the current bucket
+        for(long long low=0; low < (long long)shadow.hist.size(); low = low ? low * 2 : 1){
+            long long high = min(low ? low * 2 - 1 : 0, (long long)shadow.hist.size() - 1); // Last distance of the bucket
+            long long count = 0; // References in the bucket
+            for(long long d=low; d <= high; d++)
+                count += shadow.hist[d];
+            num_reused += count;
+            fprintf(reuse_file, "%lld,%lld,%lld,%.6f\n", low, high, count, shadow.num_ops ? (double)num_reused / shadow.num_ops : 0.0);
+        }
+        fclose(sets_file);
+        fclose(reuse_file);
+        return true;
+    }
+};
+
+/*
+    Evicted block structure, describing the block a cache fill replaced
+
+Members:
+    Boolean valid: Whether a valid block was evicted (false if an empty way was filled)
+    Boolean dirty: Whether the evicted block was dirty
+    uint64_t block: The main memory block number (at the level's line size) of the evicted block
+*/
+struct evictedBlock{
+    bool valid = false;
+    bool dirty = false;
+    uint64_t block = 0;
+};
+
+/*
+    Cache Level Class
+
+One level of a cache hierarchy: a cache memory plus its geometry, latency and
+statistics, operated on one block at a time. The replacement policy specific
+work is done by the policyLevel<Policy> subclass, created by make_level().
+
+Members:
+    cacheMemory cache: The level's cache memory
+    Integer size_cache, size_line, assoc_deg: The level's geometry
+    Character replace_policy: The level's replacement policy letter
+    Integer latency: The level's access latency in cycles
+    Long num_accesses: The number of references that reached this level
+    Long num_hits, num_misses: The number of those references that hit/missed
+    Long num_evictions: The number of valid blocks replaced by fills
+    Long num_writebacks: The number of dirty blocks written to the next level or memory
+    Long num_back_invalidations: The number of blocks invalidated to keep inclusion
+*/
+class cacheLevel{
+public:
+    cacheMemory cache;
+    int size_cache;
+    int size_line;
+    int assoc_deg;
+    char replace_policy;
+    int latency;
+    long long num_accesses = 0;
+    long long num_hits = 0;
+    long long num_misses = 0;
+    long long num_evictions = 0;
+    long long num_writebacks = 0;
+    long long num_back_invalidations = 0;
+
+    virtual ~cacheLevel(){}
+
+    // Looks a block up, updating the replacement metadata on a hit. Returns the way or -1
+    virtual int lookup(uint64_t block, const memOp &op, long long now) = 0;
+    // Fills a block (which must not be cached), returning the block it replaced
+    virtual evictedBlock insert(uint64_t block, bool dirty, const memOp &op, long long now) = 0;
+
+    // Cache set and tag of a block at this level
+    int set_of(uint64_t block) const { return (int)(block % cache.num_sets); }
+    uint64_t tag_of(uint64_t block) const { return block / cache.num_sets; }
+
+    // Returns the way holding a block or -1, without touching the replacement metadata
+    int probe(uint64_t block) const { return cache.find_tag(set_of(block), tag_of(block)); }
+
+    // Marks a cached block dirty
+    void mark_dirty(uint64_t block, int way){ cache.set_dirty(set_of(block), way, true); }
+
+    /**********************************************************************************
+    Function name:    invalidate(uint64_t block, bool &was_dirty)
+    Input parameters: uint64_t block: The main memory block number at this level's line size
+                      Boolean was_dirty: Set to whether the invalidated block was dirty
+    Return value:     Boolean: Whether the block was cached
+    Purpose:          Removes a block from the level. Its way becomes empty and is the
+                      first one refilled, so no replacement metadata needs updating
+    **********************************************************************************/
+    bool invalidate(uint64_t block, bool &was_dirty){
+        int cache_set = set_of(block); // Cache set of the block
+        int way = cache.find_tag(cache_set, tag_of(block)); // Way holding the block
+        was_dirty = false;
+        if(way < 0)
+            return false;
+        was_dirty = cache.is_dirty(cache_set, way);
+        cache.valid_bits[cache.mask_word(cache_set, way)] &= ~cacheMemory::mask_bit(way);
+        cache.set_dirty(cache_set, way, false);
+        return true;
+    }
+};
+
+// Cache level with its replacement policy compiled in
+template<class Policy>
+class policyLevel : public cacheLevel{
+public:
+    int lookup(uint64_t block, const memOp &op, long long now) override {
+        int cache_set = set_of(block); // Cache set of the block
+        int way = cache.find_tag(cache_set, tag_of(block)); // Way holding the block
+        if(way >= 0)
+            Policy::template on_hit<0>(cache, cache_set, way, cache_set * cache.assoc_deg + way, op, now);
+        return way;
+    }
+
+    evictedBlock insert(uint64_t block, bool dirty, const memOp &op, long long now) override {
+        evictedBlock evicted; // Block replaced by the fill
+        int cache_set = set_of(block); // Cache set of the block
+        int block_start = cache_set * cache.assoc_deg; // First cache block of the set
+        int way = cache.find_empty(cache_set); // Way to fill
+        bool fill_empty = (way >= 0); // Whether an empty way is filled
+        if(!fill_empty){
+            way = Policy::template victim<0>(cache, cache_set, block_start);
+            evicted.valid = true;
+            evicted.dirty = cache.is_dirty(cache_set, way);
+            evicted.block = cache.block_of(cache_set, way);
+        }
+        cache.set_valid(cache_set, way);
+        cache.set_dirty(cache_set, way, dirty);
+        cache.tags[block_start + way] = tag_of(block);
+        Policy::template on_fill<0>(cache, cache_set, way, block_start + way, op, now, fill_empty);
+        return evicted;
+    }
+};
+
+/**************************************************************************************
+Function name:         make_level(int size_cache, int size_line, int assoc_deg, char replace_policy, int latency)
+Input parameters:      Integer size_cache, size_line, assoc_deg: The level's geometry
+                       Character replace_policy: The level's replacement policy letter
+                       Integer latency: The level's access latency in cycles
+Return value:          Pointer: The new cache level, or NULL for an unknown policy
+Purpose:               Creates a cache level with its replacement policy compiled in
+**************************************************************************************/
+unique_ptr<cacheLevel> make_level(int size_cache, int size_line, int assoc_deg, char replace_policy, int latency){
+    unique_ptr<cacheLevel> level; // New cache level
+    dispatch_policy(replace_policy, [&](auto policy){
+        level.reset(new policyLevel<decltype(policy)>());
+    });
+    if(!level)
+        return level;
+    level->size_cache = size_cache;
+    level->size_line = size_line;
+    level->assoc_deg = assoc_deg;
+    level->replace_policy = (char)toupper(replace_policy);
+    level->latency = latency;
+    init_cache(level->cache, size_cache / size_line / assoc_deg, assoc_deg, replace_policy);
+    return level;
+}
+
+// Inclusion policies of a cache hierarchy
+enum inclusionPolicy { INCLUSIVE = 0, EXCLUSIVE = 1, NINE = 2 };
+
+/*
+    Cache Hierarchy Class
+
+Chains cache levels (levels[0] is closest to the CPU) and simulates every
+reference through all of them in a single pass, with write-back,
+write-allocate levels and one of three inclusion policies:
+    INCLUSIVE: blocks are filled into every level that missed, and a block
+        evicted from a level is back-invalidated from all levels above it
+    EXCLUSIVE: a block lives in one level only. Misses fill the first level,
+        a lower level hit moves the block up to the first level, and every
+        level's victims move down into the next level (the last level's
+        victims leave the hierarchy)
+    NINE: (non-inclusive, non-exclusive) blocks are filled into every level
+        that missed and evictions do not affect other levels
+Dirty victims are written back to the next level if it holds the block,
+otherwise to memory.
+
+Members:
+    Vector levels: The cache levels, first level first
+    Integer inclusion: The inclusion policy (inclusionPolicy)
+    Integer mem_latency: The main memory access latency in cycles
+    Long num_ops: The number of references simulated
+    Long total_cycles: The sum of the access latencies of all references
+    Long num_mem_reads: The number of blocks read from memory
+    Long num_mem_writebacks: The number of dirty blocks written back to memory
+*/
+class cacheHierarchy{
+public:
+    vector<unique_ptr<cacheLevel>> levels;
+    int inclusion = INCLUSIVE;
+    int mem_latency = 100;
+    long long num_ops = 0;
+    long long total_cycles = 0;
+    long long num_mem_reads = 0;
+    long long num_mem_writebacks = 0;
+
+    /**********************************************************************************
+    Function name:    access(const memOp &op)
+    Input parameters: memOp op: The memory operation (type and address set)
+    Return value:     Void - Returns nothing
+    Purpose:          Simulates one reference through the whole hierarchy
+    **********************************************************************************/
+    void access(const memOp &op){
+        int num_levels = (int)levels.size(); // Number of cache levels
+        long long now = num_ops++; // Simulator clock value of the reference
+        bool is_write = (op.op_type == 'W' || op.op_type == 'w'); // Whether the reference is a write
+        int hit_level = num_levels; // First level that hits, num_levels for memory
+        int hit_way = -1; // Way of the hit in the hit level
+
+        // Look the reference up level by level until one hits
+        for(int i=0; i < num_levels; i++){
+            cacheLevel &level = *levels[i];
+            level.num_accesses++;
+            total_cycles += level.latency;
+            hit_way = level.lookup(block_at(i, op.mem_address), op, now);
+            if(hit_way >= 0){
+                level.num_hits++;
+                hit_level = i;
+                break;
+            }
+            level.num_misses++;
+        }
+        if(hit_level == num_levels){
+            total_cycles += mem_latency;
+            num_mem_reads++;
+        }
+
+        // A first level write hit only dirties the first level
+        if(hit_level == 0){
+            if(is_write)
+                levels[0]->mark_dirty(block_at(0, op.mem_address), hit_way);
+            return;
+        }
+
+        if(inclusion == EXCLUSIVE){
+            // Move the block out of the level that hit (if any) into the first level
+            bool dirty = is_write; // Whether the block enters the first level dirty
+            bool was_dirty; // Whether the lower level copy was dirty
+            if(hit_level < num_levels && levels[hit_level]->invalidate(block_at(hit_level, op.mem_address), was_dirty))
+                dirty = dirty || was_dirty;
+            evictedBlock victim = levels[0]->insert(block_at(0, op.mem_address), dirty, op, now);
+            // Every victim moves down one level, the last level's victims leave the hierarchy
+            for(int i=0; victim.valid; i++){
+                levels[i]->num_evictions++;
+                if(i + 1 == num_levels){
+                    if(victim.dirty){
+                        levels[i]->num_writebacks++;
+                        num_mem_writebacks++;
+                    }
+                    break;
+                }
+                victim = levels[i + 1]->insert(victim.block, victim.dirty, op, now);
+            }
+        }else{
+            // Fill every level that missed, the deepest first so upper levels stay a subset
+            for(int i=hit_level - 1; i >= 0; i--){
+                uint64_t block = block_at(i, op.mem_address); // Block at this level's line size
+                evictedBlock victim = levels[i]->insert(block, i == 0 && is_write, op, now);
+                if(victim.valid)
+                    evict(i, victim);
+            }
+        }
+    }
+
+    /**********************************************************************************
+    Function name:    report()
+    Input parameters: None
+    Return value:     Void - Returns nothing
+    Purpose:          Displays the per level statistics and the average memory access time
+    **********************************************************************************/
+    void report() const {
+        static const char* inclusion_names[] = {"inclusive", "exclusive", "NINE"};
+        printf("\nCache hierarchy (%s), %lld references\n", inclusion_names[inclusion], num_ops);
+        printf("%6s %10s %6s %6s %7s %8s %12s %12s %9s %12s %12s %12s\n", "level", "size", "line", "assoc", "policy", "latency",
+               "accesses", "hits", "hit rate", "evictions", "writebacks", "back-inval");
+        cout << "------------------------------------------------------------------------------------------------------------------" << endl;
+        for(size_t i=0; i < levels.size(); i++){
+            const cacheLevel &level = *levels[i];
+            printf("%5s%zu %10d %6d %6d %7c %8d %12lld %12lld %8.2f%% %12lld %12lld %12lld\n", "L", i + 1, level.size_cache, level.size_line,
+                   level.assoc_deg, level.replace_policy, level.latency, level.num_accesses, level.num_hits,
+                   level.num_accesses ? (double)level.num_hits / level.num_accesses * 100.0 : 0.0,
+                   level.num_evictions, level.num_writebacks, level.num_back_invalidations);
+        }
+        printf("Memory: %lld block reads, %lld writebacks, latency %d cycles\n", num_mem_reads, num_mem_writebacks, mem_latency);
+        printf("End-to-end miss rate = %lld/%lld = %.2f%%\n", num_mem_reads, num_ops, num_ops ? (double)num_mem_reads / num_ops * 100.0 : 0.0);
+        printf("Average memory access time (AMAT) = %.3f cycles\n", num_ops ? (double)total_cycles / num_ops : 0.0);
+    }
+
+private:
+    // Main memory block number of an address at a level's line size
+    uint64_t block_at(int level, uint64_t mem_address) const { return mem_address / levels[level]->size_line; }
+
+    // Handles a block evicted from a level by a fill (inclusive and NINE hierarchies)
+    void evict(int level_num, const evictedBlock &victim){
+        cacheLevel &level = *levels[level_num];
+        bool dirty = victim.dirty; // Whether the victim's data must be written back
+        level.num_evictions++;
+        // Inclusive: the upper levels may not keep any part of the evicted block
+        if(inclusion == INCLUSIVE){
+            uint64_t first_address = victim.block * level.size_line; // First address of the victim
+            for(int i=0; i < level_num; i++){
+                cacheLevel &upper = *levels[i];
+                // Every upper level block inside the victim (upper line sizes are not larger). Offsets
+                // are counted instead of addresses so the last block of the address space cannot wrap
+                for(int offset=0; offset < level.size_line; offset += upper.size_line){
+                    bool was_dirty; // Whether the upper copy was dirty
+                    if(upper.invalidate((first_address + offset) / upper.size_line, was_dirty)){
+                        upper.num_back_invalidations++;
+                        dirty = dirty || was_dirty;
+                    }
+                }
+            }
+        }
+        if(!dirty)
+            return;
+        // Write the dirty data back to the next level if it holds the block, otherwise to memory
+        level.num_writebacks++;
+        if(level_num + 1 < (int)levels.size()){
+            cacheLevel &next = *levels[level_num + 1];
+            uint64_t next_block = victim.block * level.size_line / next.size_line; // Victim at the next line size
+            int way = next.probe(next_block);
+            if(way >= 0){
+                next.mark_dirty(next_block, way);
+                return;
+            }
+        }
+        num_mem_writebacks++;
+    }
+};
+
+/**************************************************************************************
+Function name:         run_hierarchy(int argc, char *argv[])
+Input parameters:      Integer argc, argv: The command line, "--hierarchy" followed by
+                           "--<option> <value>" pairs: --trace <file>,
+                           --level <size>:<line>:<assoc>:<policy>[:<latency>] (once per
+                           level, first level first), --inclusion inclusive|exclusive|nine,
+                           --mem-latency <cycles>
+Return value:          Integer: The program exit status
+Purpose:               Simulates a multi-level cache hierarchy in one pass over the trace and
+                       reports per level hits and misses and the AMAT
+**************************************************************************************/
+int run_hierarchy(int argc, char *argv[]){
+    cacheHierarchy hierarchy; // Hierarchy being simulated
+    string trace_filename; // Trace file to simulate
+
+    // Parse the "--option value" pairs of the command line
+    for(int i=2; i < argc; i += 2){
+        string key = argv[i]; // Option name
+        string value = (i + 1 < argc) ? argv[i + 1] : ""; // Option value
+        bool valid = i + 1 < argc; // Whether the option is valid
+        if(valid && key == "--trace"){
+            trace_filename = value;
+        }else if(valid && key == "--level"){
+            int size_cache, size_line, assoc_deg, latency = 1; // Level parameters
+            char policy; // Level replacement policy
+            int num_fields = sscanf(value.c_str(), "%d:%d:%d:%c:%d", &size_cache, &size_line, &assoc_deg, &policy, &latency);
+            policy = (char)toupper(policy);
+            valid = num_fields >= 4 && size_line > 0 && assoc_deg > 0 && size_cache >= size_line * assoc_deg &&
+                    size_cache % (size_line * assoc_deg) == 0 && policy != 'O' && valid_policy(policy, assoc_deg);
+            if(valid)
+                hierarchy.levels.push_back(make_level(size_cache, size_line, assoc_deg, policy, latency));
+        }else if(valid && key == "--inclusion"){
+            if(value == "inclusive")
+                hierarchy.inclusion = INCLUSIVE;
+            else if(value == "exclusive")
+                hierarchy.inclusion = EXCLUSIVE;
+            else if(value == "nine")
+                hierarchy.inclusion = NINE;
+            else
+                valid = false;
+        }else if(valid && key == "--mem-latency"){
+            valid = from_chars(value.data(), value.data() + value.size(), hierarchy.mem_latency).ec == errc();
+        }else{
+            valid = false;
+        }
+        if(!valid){
+            printf("---Invalid hierarchy option %s %s!---\n", key.c_str(), value.c_str());
+            return 1;
+        }
+    }
+    if(trace_filename.empty() || hierarchy.levels.empty()){
+        printf("---A hierarchy needs --trace and at least one --level!---\n");
+        return 1;
+    }
+    // Lower levels may not have smaller lines (exclusive levels must share one line size)
+    for(size_t i=1; i < hierarchy.levels.size(); i++){
+        int upper_line = hierarchy.levels[i - 1]->size_line; // Line size of the level above
+        int line = hierarchy.levels[i]->size_line; // Line size of this level
+        if(line < upper_line || line % upper_line != 0 || (hierarchy.inclusion == EXCLUSIVE && line != upper_line)){
+            printf("---Invalid line size for level %zu!---\n", i + 1);
+            return 1;
+        }
+    }
+
+    // Stream the trace once through the whole hierarchy
+    traceReader trace; // Reader of the trace file
+    vector<memOp> operations(TRACE_BATCH_SIZE); // Batch of memory operations
+    int num_batch_ops; // Number of memory operations in the current batch
+    if(!trace.open_trace(trace_filename)){
+        printf("---Unable to open input file %s!---\n", trace_filename.c_str());
+        return 1;
+    }
+    while((num_batch_ops = trace.next_batch(operations.data(), TRACE_BATCH_SIZE)) > 0){
+        for(int i=0; i < num_batch_ops; i++)
+            hierarchy.access(operations[i]);
+    }
+    hierarchy.report();
+    return 0;
+}
+
+// Coherence states of a cache block. MESI uses every state but OWNED
+enum coherenceState : uint8_t { STATE_I = 0, STATE_S = 1, STATE_E = 2, STATE_O = 3, STATE_M = 4 };
+
+/*
+    Core statistics structure for the coherence simulation
+
+Members:
+    Long num_accesses, num_hits, num_misses: The core's references and their results
+    Long num_coherence_misses: Misses to a block the core lost to another core's write
+    Long num_true_sharing: Coherence misses to the word the other core wrote
+    Long num_false_sharing: Coherence misses to another word of the same block
+    Long num_invalidations: The number of the core's blocks invalidated by other cores
+    Long num_upgrades: The number of writes to shared blocks (BusUpgr)
+    Long num_bus_reads: The number of read misses put on the bus (BusRd)
+    Long num_bus_read_excl: The number of write misses put on the bus (BusRdX)
+    Long num_writebacks: The number of dirty blocks written back to memory
+    Long num_supplied: The number of blocks the core supplied to other cores' misses
+*/
+struct coreStats{
+    long long num_accesses = 0;
+    long long num_hits = 0;
+    long long num_misses = 0;
+    long long num_coherence_misses = 0;
+    long long num_true_sharing = 0;
+    long long num_false_sharing = 0;
+    long long num_invalidations = 0;
+    long long num_upgrades = 0;
+    long long num_bus_reads = 0;
+    long long num_bus_read_excl = 0;
+    long long num_writebacks = 0;
+    long long num_supplied = 0;
+
+    // Number of bus transactions the core started
+    long long bus_transactions() const { return num_bus_reads + num_bus_read_excl + num_upgrades + num_writebacks; }
+};
+
+/*
+    Coherent Multi-Core System Class
+
+Private caches of equal geometry, one per core, kept coherent by snooping a
+shared bus with the MESI or MOESI protocol:
+    Read miss: BusRd. A Modified or Owned copy supplies the block. Under MESI
+        a Modified supplier writes it back and drops to Shared, under MOESI
+        it becomes Owned and memory stays stale. Exclusive copies drop to
+        Shared. The reader gets Exclusive if no other core has the block,
+        Shared otherwise
+    Write hit: Modified stays, Exclusive becomes Modified silently, Shared
+        and Owned send BusUpgr, invalidating every other copy
+    Write miss: BusRdX. Every other copy is invalidated (a Modified or Owned
+        copy supplies the block) and the writer gets Modified
+    Eviction: Modified and Owned blocks are written back to memory
+A miss to a block the core lost to another core's invalidation is a coherence
+miss. It is true sharing if it accesses the word whose write caused the
+invalidation, and false sharing otherwise. Lost blocks are remembered in the
+way they were invalidated from, and age out after assoc_deg fills of their set
+(by then the block would have been replaced anyway), so the record is the size
+of the cache however long the trace is.
+
+Members:
+    Vector caches: The private cache of each core
+    Vector states: The coherence state of every cache block of each core
+    Vector stats: The statistics of each core
+    Vector lost_blocks: Per core and cache block, the block lost to an invalidation
+        of that way, if any
+    Vector set_fills: Per core and cache set, the number of fills of the set
+    Integers size_cache, size_line, assoc_deg: The private cache geometry
+    Character replace_policy: The private caches' replacement policy
+    Boolean moesi: Whether the protocol is MOESI rather than MESI
+*/
+class coherentSystem{
+public:
+    // Block lost to another core's write: the block, the address written and the
+    // fill count of its set when it was lost (-1 for none)
+    struct lostBlock { uint64_t block = 0; uint64_t mem_address = 0; long long fill = -1; };
+
+    vector<unique_ptr<cacheLevel>> caches;
+    vector<vector<uint8_t>> states;
+    vector<coreStats> stats;
+    vector<vector<lostBlock>> lost_blocks;
+    vector<vector<long long>> set_fills;
+    int size_cache = 0;
+    int size_line = 0;
+    int assoc_deg = 0;
+    char replace_policy = 'L';
+    bool moesi = false;
+
+    /**********************************************************************************
+    Function name:    init(int num_cores, int size_cache, int size_line, int assoc_deg, char replace_policy)
+    Input parameters: Integer num_cores: The number of cores
+                      Integer size_cache, size_line, assoc_deg: The private cache geometry
+                      Character replace_policy: The private caches' replacement policy
+    Return value:     Void - Returns nothing
+    Purpose:          Creates an empty private cache for every core
+    **********************************************************************************/
+    void init(int num_cores, int size_cache, int size_line, int assoc_deg, char replace_policy){
+        this->size_cache = size_cache;
+        this->size_line = size_line;
+        this->assoc_deg = assoc_deg;
+        this->replace_policy = replace_policy;
+        caches.clear();
+        states.clear();
+        stats.clear();
+        lost_blocks.clear();
+        set_fills.clear();
+        add_cores(num_cores);
+    }
+
+    /**********************************************************************************
+    Function name:    add_cores(int num_cores)
+    Input parameters: Integer num_cores: The number of cores the system needs
+    Return value:     Void - Returns nothing
+    Purpose:          Adds empty private caches until there are num_cores cores. A core
+                      added when it first appears in a trace is the same as one that
+                      was idle until then
+    **********************************************************************************/
+    void add_cores(int num_cores){
+        while((int)caches.size() < num_cores){
+            caches.push_back(make_level(size_cache, size_line, assoc_deg, replace_policy, 1));
+            states.emplace_back(size_cache / size_line, STATE_I);
+            stats.emplace_back();
+            lost_blocks.emplace_back(size_cache / size_line);
+            set_fills.emplace_back(size_cache / size_line / assoc_deg, 0);
+        }
+    }
+
+    /**********************************************************************************
+    Function name:    access(int core, const memOp &op, long long now)
+    Input parameters: Integer core: The core issuing the memory operation
+                      memOp op: The memory operation (type and address set)
+                      Long now: The simulator clock value of the operation
+    Return value:     Void - Returns nothing
+    Purpose:          Simulates one reference of one core, including the snooping of
+                      every other core's cache
+    **********************************************************************************/
+    void access(int core, const memOp &op, long long now){
+        cacheLevel &cache = *caches[core]; // Cache of the core
+        coreStats &core_stats = stats[core]; // Statistics of the core
+        uint64_t block = op.mem_address / cache.size_line; // Main memory block referenced
+        bool is_write = (op.op_type == 'W' || op.op_type == 'w'); // Whether the reference is a write
+        int way = cache.lookup(block, op, now); // Way holding the block, -1 on a miss
+
+        core_stats.num_accesses++;
+        // Hit: only writes to blocks other cores may hold need the bus
+        if(way >= 0){
+            uint8_t &state = states[core][state_index(cache, block, way)]; // State of the block
+            core_stats.num_hits++;
+            if(is_write && (state == STATE_S || state == STATE_O)){
+                core_stats.num_upgrades++;
+                invalidate_others(core, block, op.mem_address, false);
+            }
+            if(is_write)
+                state = STATE_M;
+            return;
+        }
+
+        // Miss: classify it, snoop the other caches, then fill the block
+        core_stats.num_misses++;
+        int cache_set = cache.set_of(block); // Cache set of the block
+        lostBlock* lost = find_lost(core, cache_set, block); // Invalidation that removed the block, if any
+        if(lost != NULL){
+            core_stats.num_coherence_misses++;
+            if(op.mem_address / WORD_BYTES == lost->mem_address / WORD_BYTES)
+                core_stats.num_true_sharing++;
+            else
+                core_stats.num_false_sharing++;
+            lost->fill = -1;
+        }
+        set_fills[core][cache_set]++;
+        uint8_t new_state; // State the block is filled in
+        if(is_write){
+            core_stats.num_bus_read_excl++;
+            invalidate_others(core, block, op.mem_address, true);
+            new_state = STATE_M;
+        }else{
+            core_stats.num_bus_reads++;
+            new_state = snoop_read(core, block) ? STATE_S : STATE_E;
+        }
+        cache.insert(block, false, op, now);
+        way = cache.probe(block);
+        uint8_t &state = states[core][state_index(cache, block, way)]; // State of the filled way
+        // The replaced block (if any) is written back if this core held it dirty
+        if(state == STATE_M || state == STATE_O)
+            core_stats.num_writebacks++;
+        state = new_state;
+    }
+
+    /**********************************************************************************
+    Function name:    report()
+    Input parameters: None
+    Return value:     Void - Returns nothing
+    Purpose:          Displays the per core coherence statistics and their totals
+    **********************************************************************************/
+    void report() const {
+        coreStats total; // Statistics summed over every core
+        printf("\n%s coherence, %zu cores\n", moesi ? "MOESI" : "MESI", caches.size());
+        printf("%5s %12s %9s %12s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "core", "accesses", "hit rate", "misses", "coherence",
+               "true shr", "false shr", "inval", "upgrades", "BusRd", "BusRdX", "writeback", "bus total");
+        cout << "-----------------------------------------------------------------------------------------------------------------------------------" << endl;
+        for(size_t core=0; core <= stats.size(); core++){
+            const coreStats &row = (core < stats.size()) ? stats[core] : total; // Core or total row
+            if(core < stats.size()){
+                printf("%5zu ", core);
+                total.num_accesses += row.num_accesses;
+                total.num_hits += row.num_hits;
+                total.num_misses += row.num_misses;
+                total.num_coherence_misses += row.num_coherence_misses;
+                total.num_true_sharing += row.num_true_sharing;
+                total.num_false_sharing += row.num_false_sharing;
+                total.num_invalidations += row.num_invalidations;
+                total.num_upgrades += row.num_upgrades;
+                total.num_bus_reads += row.num_bus_reads;
+                total.num_bus_read_excl += row.num_bus_read_excl;
+                total.num_writebacks += row.num_writebacks;
+                total.num_supplied += row.num_supplied;
+            }else{
+                printf("%5s ", "total");
+            }
+            printf("%12lld %8.2f%% %12lld %10lld %10lld %10lld %10lld %10lld %10lld %10lld %10lld %10lld\n", row.num_accesses,
+                   row.num_accesses ? (double)row.num_hits / row.num_accesses * 100.0 : 0.0, row.num_misses, row.num_coherence_misses,
+                   row.num_true_sharing, row.num_false_sharing, row.num_invalidations, row.num_upgrades, row.num_bus_reads,
+                   row.num_bus_read_excl, row.num_writebacks, row.bus_transactions());
+        }
+        printf("Cache-to-cache transfers = %lld, coherence misses = %.2f%% of misses\n", total.num_supplied,
+               total.num_misses ? (double)total.num_coherence_misses / total.num_misses * 100.0 : 0.0);
+    }
+
+private:
+    // Index of a cached block in its core's state vector
+    static int state_index(const cacheLevel &cache, uint64_t block, int way){ return cache.set_of(block) * cache.assoc_deg + way; }
 
-Members:
-    Character op_type: Memory operation type. 'R' = Read and 'W' = Write
-    Integer mem_address: The numeric main memory address to either read or write
-    Integer mem_block: The numeric main memory block
-    String tag: The string representation of the memory address tag
-    Integer cache_set: The cache set the main memory block is associated with
-    Integer cache_block_start: The starting block cache of the cache set
-    String result: The result of the memory operation "hit" or "miss"
-*/
-struct memOp{
-    char op_type;
-    int  mem_address;
-    int  mem_block;
-    string  tag;
-    int  cache_set;
-    int  cache_block_start;
-    string result;
+    // Returns a core's unexpired record of losing a block, or NULL
+    lostBlock* find_lost(int core, int cache_set, uint64_t block){
+        lostBlock* set_lost = &lost_blocks[core][cache_set * assoc_deg]; // Lost blocks of the set
+        for(int way=0; way < assoc_deg; way++){
+            if(set_lost[way].fill >= 0 && set_lost[way].block == block &&
+               set_fills[core][cache_set] - set_lost[way].fill < assoc_deg)
+                return &set_lost[way];
+        }
+        return NULL;
+    }
+
+    // Invalidates every other core's copy of a block for a write to the given address.
+    // A write miss (BusRdX) reads the block from a dirty owner, an upgrade moves no data
+    void invalidate_others(int core, uint64_t block, uint64_t mem_address, bool read_block){
+        for(int other=0; other < (int)caches.size(); other++){
+            bool was_dirty; // Unused, dirtiness is kept in the coherence state
+            int way = (other == core) ? -1 : caches[other]->probe(block); // Way of the other copy
+            if(way < 0)
+                continue;
+            int index = state_index(*caches[other], block, way); // Cache block of the other copy
+            uint8_t &state = states[other][index];
+            // The owner of a dirty block supplies it to the writer
+            if(read_block && (state == STATE_M || state == STATE_O))
+                stats[other].num_supplied++;
+            state = STATE_I;
+            caches[other]->invalidate(block, was_dirty);
+            stats[other].num_invalidations++;
+            lostBlock &lost = lost_blocks[other][index]; // Record of the way's lost block
+            lost.block = block;
+            lost.mem_address = mem_address;
+            lost.fill = set_fills[other][caches[other]->set_of(block)];
+        }
+    }
+
+    // Snoops a read miss in the other caches, returns whether another core has the block
+    bool snoop_read(int core, uint64_t block){
+        bool shared = false; // Whether another core holds the block
+        for(int other=0; other < (int)caches.size(); other++){
+            int way = (other == core) ? -1 : caches[other]->probe(block); // Way of the other copy
+            if(way < 0)
+                continue;
+            uint8_t &state = states[other][state_index(*caches[other], block, way)];
+            shared = true;
+            if(state == STATE_M){
+                stats[other].num_supplied++;
+                // MESI writes the block back while supplying it, MOESI keeps it dirty as the owner
+                if(moesi){
+                    state = STATE_O;
+                }else{
+                    stats[other].num_writebacks++;
+                    state = STATE_S;
+                }
+            }else if(state == STATE_O){
+                stats[other].num_supplied++;
+            }else if(state == STATE_E){
+                state = STATE_S;
+            }
+        }
+        return shared;
+    }
 };
 
+/**************************************************************************************
+Function name:         run_coherence(int argc, char *argv[])
+Input parameters:      Integer argc, argv: The command line, "--coherence" followed by
+                           "--<option> <value>" pairs: --trace <file> (once per core, core 0
+                           first), --core-trace <file> (one text trace with lines
+                           "<core> <R|W> <address>"), --cache <size>:<line>:<assoc>:<policy>,
+                           --protocol mesi|moesi
+Return value:          Integer: The program exit status
+Purpose:               Simulates private per-core caches kept coherent over a snooping bus
+                       and reports the coherence statistics of every core. Per-core traces
+                       are interleaved one reference per core at a time, a core-ID trace is
+                       simulated in file order
+**************************************************************************************/
+int run_coherence(int argc, char *argv[]){
+    // Largest number of cores, each has a private cache and snoops every other one
+    const int MAX_CORES = 1024;
+    coherentSystem system; // Multi-core system being simulated
+    vector<string> trace_filenames; // Per-core trace files
+    string core_trace_filename; // Trace file with a core-ID column
+    int size_cache = 0, size_line = 0, assoc_deg = 0; // Private cache geometry
+    char replace_policy = 'L'; // Private cache replacement policy
+
+    // Parse the "--option value" pairs of the command line
+    for(int i=2; i < argc; i += 2){
+        string key = argv[i]; // Option name
+        string value = (i + 1 < argc) ? argv[i + 1] : ""; // Option value
+        bool valid = i + 1 < argc; // Whether the option is valid
+        if(valid && key == "--trace"){
+            trace_filenames.push_back(value);
+        }else if(valid && key == "--core-trace"){
+            core_trace_filename = value;
+        }else if(valid && key == "--cache"){
+            valid = sscanf(value.c_str(), "%d:%d:%d:%c", &size_cache, &size_line, &assoc_deg, &replace_policy) == 4;
+            replace_policy = (char)toupper(replace_policy);
+        }else if(valid && key == "--protocol"){
+            valid = (value == "mesi" || value == "moesi");
+            system.moesi = (value == "moesi");
+        }else{
+            valid = false;
+        }
+        if(!valid){
+            printf("---Invalid coherence option %s %s!---\n", key.c_str(), value.c_str());
+            return 1;
+        }
+    }
+    if(size_line <= 0 || assoc_deg <= 0 || size_cache < size_line * assoc_deg || size_cache % (size_line * assoc_deg) != 0 ||
+       replace_policy == 'O' || !valid_policy(replace_policy, assoc_deg)){
+        printf("---Invalid private cache configuration!---\n");
+        return 1;
+    }
+    if(trace_filenames.empty() == core_trace_filename.empty()){
+        printf("---Give either one --trace per core or one --core-trace!---\n");
+        return 1;
+    }
+
+    long long now = 0; // Simulator clock value
+    memOp op; // Current memory operation
+    if(!core_trace_filename.empty()){
+        // One trace with a core-ID column, streamed in batches. The number of cores is
+        // the largest ID + 1, a core's cache is added when the core first appears
+        traceReader trace; // Reader of the core-ID trace
+        vector<memOp> ops(TRACE_BATCH_SIZE); // Batch of memory operations
+        vector<int> cores(TRACE_BATCH_SIZE); // Core of each memory operation of the batch
+        int num_batch_ops; // Number of memory operations in the current batch
+        if(!trace.open_trace(core_trace_filename, true)){
+            printf("---Unable to open input file %s!---\n", core_trace_filename.c_str());
+            return 1;
+        }
+        system.init(0, size_cache, size_line, assoc_deg, replace_policy);
+        while((num_batch_ops = trace.next_batch(ops.data(), TRACE_BATCH_SIZE, cores.data())) > 0){
+            for(int k=0; k < num_batch_ops; k++){
+                if(cores[k] >= MAX_CORES){
+                    printf("---Core ID %d is not below %d!---\n", cores[k], MAX_CORES);
+                    return 1;
+                }
+                system.add_cores(cores[k] + 1);
+                system.access(cores[k], ops[k], now++);
+            }
+        }
+    }else{
+        // One trace per core, interleaved round-robin until every trace ends
+        int num_cores = (int)trace_filenames.size(); // Number of cores
+        vector<traceReader> traces(num_cores); // Reader of each core's trace
+        int num_active = num_cores; // Number of cores with references left
+        for(int core=0; core < num_cores; core++){
+            if(!traces[core].open_trace(trace_filenames[core])){
+                printf("---Unable to open input file %s!---\n", trace_filenames[core].c_str());
+                return 1;
+            }
+        }
+        system.init(num_cores, size_cache, size_line, assoc_deg, replace_policy);
+        vector<bool> active(num_cores, true); // Whether each core has references left
+        while(num_active > 0){
+            for(int core=0; core < num_cores; core++){
+                if(!active[core])
+                    continue;
+                if(traces[core].next_batch(&op, 1) == 0){
+                    active[core] = false;
+                    num_active--;
+                    continue;
+                }
+                system.access(core, op, now++);
+            }
+        }
+    }
+    system.report();
+    return 0;
+}
+
 /*
-    Cache block structure for use in keeping track of cache status
+    Checkpoint file header, followed by the cache memory's vectors (each as a
+    uint64_t element count and the elements, see save_checkpoint) and the
+    main memory blocks seen so far
 
 Members:
-    Boolean valid: Whether the cache block contains valid data
-    Boolean dirty: Whether the cache block data is dirty
-    String tag: The tag of the block's data
-    Int data: The main memory block number of the cache data
-    Int cache_set: The cache set associated with the cache block
+    Character magic: CHECKPOINT_MAGIC, identifies a checkpoint file
+    Integer version: The format version, CHECKPOINT_VERSION
+    uint64_t size_main_mem, integers size_cache, size_line, assoc_deg: The simulated configuration
+    Character replace_policy: The cache replacement policy
+    Bytes write_back, write_allocate: The write policies
+    Longs access_clock, num_hits: The simulator clock and hit count (MemorySim)
+    Longs num_fills, num_writebacks, num_write_throughs: The memory traffic (memTraffic)
+    Longs num_ops, num_possible_hits: The hit rate statistics (hitStats)
 */
-struct cacheBlock{
-    bool valid;
-    bool dirty;
-    string tag;
-    int data;
-    int cache_set;
+struct checkpointHeader{
+    char magic[8];
+    uint32_t version;
+    uint64_t size_main_mem;
+    int32_t size_cache;
+    int32_t size_line;
+    int32_t assoc_deg;
+    char replace_policy;
+    uint8_t write_back;
+    uint8_t write_allocate;
+    uint8_t reserved;
+    int64_t access_clock;
+    int64_t num_hits;
+    int64_t num_fills;
+    int64_t num_writebacks;
+    int64_t num_write_throughs;
+    int64_t num_ops;
+    int64_t num_possible_hits;
 };
+const char CHECKPOINT_MAGIC[8] = {'M', 'E', 'M', 'C', 'K', 'P', 'T', '1'};
+const uint32_t CHECKPOINT_VERSION = 4;
+
+// Writes a vector as its element count followed by its elements
+template<class T, class Alloc>
+void write_vector(FILE* file, const vector<T, Alloc> &values){
+    uint64_t num_values = values.size(); // Number of elements
+    fwrite(&num_values, sizeof(num_values), 1, file);
+    fwrite(values.data(), sizeof(T), values.size(), file);
+}
+// Returns the number of bytes between the position of a file and its end
+inline long long file_bytes_left(FILE* file){
+    struct stat file_stat; // Status of the file, for its size
+    long long position = ftell(file); // Current position in the file
+    if(position < 0 || fstat(fileno(file), &file_stat) != 0)
+        return 0;
+    return max(0LL, (long long)file_stat.st_size - position);
+}
+// Reads a vector written by write_vector. Returns whether it was read completely. The element
+// count is checked against max_values and the rest of the file before anything is allocated
+template<class T, class Alloc>
+bool read_vector(FILE* file, vector<T, Alloc> &values, uint64_t max_values){
+    uint64_t num_values; // Number of elements
+    if(fread(&num_values, sizeof(num_values), 1, file) != 1 || num_values > max_values ||
+       num_values > (uint64_t)file_bytes_left(file) / sizeof(T))
+        return false;
+    values.resize(num_values);
+    return fread(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+
+/**************************************************************************************
+Function name:         save_checkpoint(string filename, const MemorySim &mem_sim, const cacheMemory &cache,
+                                       const hitStats &stats)
+Input parameters:      String filename: The checkpoint file to write
+                       MemorySim mem_sim: The simulator (configuration, clock and counters)
+                       cacheMemory cache: The cache memory with its replacement metadata
+                       hitStats stats: The hit rate statistics
+Return value:          Boolean: Whether the checkpoint was written
+Purpose:               Saves the whole simulator state so a later run can continue it with
+                       new trace segments (see load_checkpoint)
+**************************************************************************************/
+bool save_checkpoint(string filename, const MemorySim &mem_sim, const cacheMemory &cache, const hitStats &stats){
+    FILE* checkpoint_file = fopen(filename.c_str(), "wb");
+    if(checkpoint_file == NULL){
+        printf("---Unable to open checkpoint file %s!---\n", filename.c_str());
+        return false;
+    }
+    checkpointHeader header = {}; // Header of the checkpoint
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.size_main_mem = mem_sim.size_main_mem;
+    header.size_cache = mem_sim.size_cache;
+    header.size_line = mem_sim.size_line;
+    header.assoc_deg = mem_sim.assoc_deg;
+    header.replace_policy = mem_sim.replace_policy;
+    header.write_back = mem_sim.write_back;
+    header.write_allocate = mem_sim.write_allocate;
+    header.access_clock = mem_sim.access_clock;
+    header.num_hits = mem_sim.num_hits;
+    header.num_fills = mem_sim.traffic.num_fills;
+    header.num_writebacks = mem_sim.traffic.num_writebacks;
+    header.num_write_throughs = mem_sim.traffic.num_write_throughs;
+    header.num_ops = stats.num_ops;
+    header.num_possible_hits = stats.num_possible_hits;
+    fwrite(&header, sizeof(header), 1, checkpoint_file);
+
+    // Cache contents, then every replacement metadata vector (empty unless used by the policy)
+    write_vector(checkpoint_file, cache.tags);
+    write_vector(checkpoint_file, cache.valid_bits);
+    write_vector(checkpoint_file, cache.dirty_bits);
+    write_vector(checkpoint_file, cache.last_used);
+    write_vector(checkpoint_file, cache.inserted);
+    write_vector(checkpoint_file, cache.plru_bits);
+    write_vector(checkpoint_file, cache.rrpv);
+    write_vector(checkpoint_file, cache.rng_state);
+    write_vector(checkpoint_file, cache.use_count);
+    // Allocated pages of the seen block bitmap, page numbers then words
+    write_vector(checkpoint_file, stats.seen_blocks.page_nums);
+    write_vector(checkpoint_file, stats.seen_blocks.words);
+    bool written = !ferror(checkpoint_file); // Whether every write succeeded
+    fclose(checkpoint_file);
+    if(!written)
+        printf("---Unable to write checkpoint file %s!---\n", filename.c_str());
+    return written;
+}
+
+/**************************************************************************************
+Function name:         load_checkpoint(string filename, MemorySim &mem_sim, cacheMemory &cache, hitStats &stats)
+Input parameters:      String filename: The checkpoint file to read
+                       MemorySim mem_sim: Receives the configuration, clock and counters
+                       cacheMemory cache: Receives the cache memory and replacement metadata
+                       hitStats stats: Receives the hit rate statistics
+Return value:          Boolean: Whether the checkpoint was read
+Purpose:               Restores a simulator state saved by save_checkpoint. The simulator
+                       clock continues from the checkpoint, so replacement decisions on
+                       the next trace segment are the same as if the segments had been
+                       simulated as one trace
+**************************************************************************************/
+bool load_checkpoint(string filename, MemorySim &mem_sim, cacheMemory &cache, hitStats &stats){
+    FILE* checkpoint_file = fopen(filename.c_str(), "rb");
+    checkpointHeader header; // Header of the checkpoint
+    vector<uint64_t> seen_page_nums, seen_words; // Seen block bitmap pages of the checkpoint (see pagedBitmap)
+    if(checkpoint_file == NULL){
+        printf("---Unable to open checkpoint file %s!---\n", filename.c_str());
+        return false;
+    }
+    bool valid = fread(&header, sizeof(header), 1, checkpoint_file) == 1 &&
+                 memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) == 0 && header.version == CHECKPOINT_VERSION &&
+                 header.size_main_mem != 0 && header.size_line > 0 && header.assoc_deg > 0 &&
+                 header.size_cache >= (long long)header.size_line * header.assoc_deg &&
+                 header.size_cache % ((long long)header.size_line * header.assoc_deg) == 0 &&
+                 valid_policy(header.replace_policy, header.assoc_deg) && header.replace_policy != 'O' &&
+                 // The file must at least hold the tags before the cache is allocated
+                 (long long)(header.size_cache / header.size_line) <= file_bytes_left(checkpoint_file) / (long long)sizeof(uint64_t);
+    if(valid){
+        mem_sim.size_main_mem = header.size_main_mem;
+        mem_sim.size_cache = header.size_cache;
+        mem_sim.size_line = header.size_line;
+        mem_sim.assoc_deg = header.assoc_deg;
+        mem_sim.replace_policy = header.replace_policy;
+        mem_sim.write_back = header.write_back;
+        mem_sim.write_allocate = header.write_allocate;
+        mem_sim.access_clock = header.access_clock;
+        mem_sim.num_hits = header.num_hits;
+        mem_sim.traffic.num_fills = header.num_fills;
+        mem_sim.traffic.num_writebacks = header.num_writebacks;
+        mem_sim.traffic.num_write_throughs = header.num_write_throughs;
+        stats.num_ops = header.num_ops;
+        stats.num_possible_hits = header.num_possible_hits;
+        // Allocate the cache for its policy, then overwrite it with the saved state
+        init_cache(cache, header.size_cache / header.size_line / header.assoc_deg, header.assoc_deg, header.replace_policy);
+        size_t num_cache_blocks = cache.tags.size(); // Number of cache blocks
+        size_t num_rrpv = cache.rrpv.size(), num_rng = cache.rng_state.size(); // Expected metadata sizes
+        size_t num_last_used = cache.last_used.size(), num_inserted = cache.inserted.size();
+        size_t num_plru = cache.plru_bits.size(), num_use_count = cache.use_count.size();
+        size_t num_mask_words = cache.valid_bits.size(); // Expected valid and dirty mask words
+        // No vector may be longer than the geometry and policy of the header allow
+        valid = read_vector(checkpoint_file, cache.tags, num_cache_blocks) &&
+                read_vector(checkpoint_file, cache.valid_bits, num_mask_words) &&
+                read_vector(checkpoint_file, cache.dirty_bits, num_mask_words) &&
+                read_vector(checkpoint_file, cache.last_used, num_last_used) && read_vector(checkpoint_file, cache.inserted, num_inserted) &&
+                read_vector(checkpoint_file, cache.plru_bits, num_plru) && read_vector(checkpoint_file, cache.rrpv, num_rrpv) &&
+                read_vector(checkpoint_file, cache.rng_state, num_rng) && read_vector(checkpoint_file, cache.use_count, num_use_count) &&
+                // Every bitmap page was touched by at least one memory operation
+                read_vector(checkpoint_file, seen_page_nums, (uint64_t)max(0LL, (long long)header.num_ops)) &&
+                read_vector(checkpoint_file, seen_words, seen_page_nums.size() * pagedBitmap::PAGE_WORDS);
+        // Every vector must match the geometry and policy of the header
+        valid = valid && cache.tags.size() == num_cache_blocks &&
+                cache.valid_bits.size() == (size_t)cache.num_sets * cache.num_mask_words && cache.dirty_bits.size() == cache.valid_bits.size() &&
+                cache.last_used.size() == num_last_used && cache.inserted.size() == num_inserted && cache.plru_bits.size() == num_plru &&
+                cache.rrpv.size() == num_rrpv && cache.rng_state.size() == num_rng && cache.use_count.size() == num_use_count &&
+                stats.seen_blocks.restore(seen_page_nums, seen_words);
+    }
+    fclose(checkpoint_file);
+    if(!valid)
+        printf("---Invalid checkpoint file %s!---\n", filename.c_str());
+    return valid;
+}
+
+// Per-operation result stream formats
+enum resultFormat { RESULTS_CSV = 0, RESULTS_BIN = 1 };
 
 /*
-    Memory Simulator Class
+    Result Stream Class
 
-Used to store all necessary information for the simulation
-of a memory hierarchy and memory operations.
+Buffered, optionally sampled per-operation result output, used instead of the
+full display_ops table. Sampling keeps every Nth operation and/or only the
+misses. The CSV format has one "index,op,address,block,set,result" row per
+operation. The binary format has two little-endian uint64_t per operation:
+the operation index, then (address << 2) | (is_write << 1) | is_hit.
 
 Members:
-    Integer size_main_mem: The main memory size in bytes
-    Integer size_cache: The cache memory size in bytes
-    Integer size_line: The size of a line/block of memory
-    Integer assoc_deg: The degree of association of the cache
-    Character replace_policy: The system's replace policy
-        "L" for least-recently-used or
-        "F" for first-in-first-out
-    String input_filename: The filename of the memory instructions file
-    Integer num_tag_bits: The number of tag bits in the memory addresses
+    FILE* file: The output file
+    Integer format: The output format (resultFormat)
+    Long sample_every: Keep operations whose index is a multiple of this
+    Boolean misses_only: Keep only the operations that missed
+    Vector buffer: Output not yet written to the file
 */
-class MemorySim{
+class resultStream{
 public:
-    int size_main_mem;
-    int size_cache;
-    int size_line;
-    int assoc_deg;
-    char replace_policy;
-    string input_filename;
-    int num_tag_bits;
+    FILE* file;
+    int format;
+    long long sample_every;
+    bool misses_only;
+    vector<char> buffer;
 
-    MemorySim(){} // Default constructor
+    static constexpr size_t BUFFER_BYTES = 1 << 20; // Buffered output written at a time
 
-    /**********************************************************************************
-    Function name:         calc_mem_addr_layout()
-    Input parameters:      None
-    Return value:          Void - Returns nothing
-    Purpose:               Calculates and displays various memory simulator parameters necessary for operation
-    ***********************************************************************************
-    void calc_mem_addr_layout(){
-        cout << "\nSimulator Output:" << endl;
-        // Calculate number of address, convert to integer, and print to screen
-        int num_addr_lines = (int)log2(size_main_mem);
-        cout << "Total address lines required = " << num_addr_lines << endl;
-        // Calculate number of offset bits, convert to integer, and print to screen
-        int num_offset_bits = (int)log2(size_line);
-        cout << "Number of bits for offset = " << num_offset_bits << endl;
-        // Calculate number of index bits, convert to integer, and print to screen
-        int num_index_bits = (int)log2(size_cache / size_line / assoc_deg);
-        cout << "Number of bits for index = " << num_index_bits << endl;
-        // Calculate number of tag bits and print to screen
-        num_tag_bits = num_addr_lines - num_offset_bits - num_index_bits;
-        cout << "Number of bits for tag = " << num_tag_bits << endl;
-        // Calculate cache size required and print to screen
-        // num_cache_blks * (1+1(dirty and valid bits) + num_tag_bits + 8 * block_size) / 8
-        int size_total_cache = (int)(size_cache / size_line * (1 + 1 + num_tag_bits) / 8 + size_cache);
-        cout << "Total cache size required = " << size_total_cache << " bytes";
+    resultStream(){ file = NULL; format = RESULTS_CSV; sample_every = 1; misses_only = false; } // Default constructor
+    ~resultStream(){ close_stream(); } // Flush and close on destruction
+
+    // Opens the output file, writing the CSV header. Returns whether the file was opened
+    bool open_stream(string filename){
+        file = fopen(filename.c_str(), "wb");
+        if(file == NULL)
+            return false;
+        buffer.reserve(BUFFER_BYTES + 256);
+        if(format == RESULTS_CSV)
+            append("index,op,address,block,set,result\n");
+        return true;
     }
 
     /**********************************************************************************
-    Function name:    exec_ops(memOp ops[], int num_ops, cacheBlock cache_blocks[], int num_cache_blocks)
-    Input parameters: memOp ops[]: The array of memory operations to be executed
+    Function name:    write_ops(const memOp ops[], int num_ops, long long first_index)
+    Input parameters: memOp ops[]: The array of executed memory operations
                       integer num_ops: The number of memory operations
-                        cacheBlock cache_blocks[]: 
-                            The array of cache blocks emulating cache memory
-                      integer num_cache_blocks: 
-                            The number of cache blocks in the system cache
+                      Long first_index: The trace index of ops[0]
     Return value:     Void - Returns nothing
-    Purpose:          Runs the memory operations with the given cache memory and simulator parameters
+    Purpose:          Adds the sampled operations of a batch to the stream
     **********************************************************************************/
-    void exec_ops(memOp ops[], int num_ops, cacheBlock cache_blocks[], int num_cache_blocks){
-        bool tag_found; // Boolean flag of whether or not a tag match was found
-        int cache_block_idx; // Variable to store the current cache block index to be searched
-        //cout << "Executing operations" << endl;
-        // Iterate through all memory operations
+    void write_ops(const memOp ops[], int num_ops, long long first_index){
+        if(file == NULL)
+            return;
         for(int i=0; i < num_ops; i++){
-            //printf("\nMem op: %d, address: %d,  tag: %s\n", i, ops[i].mem_address, ops[i].tag.c_str());
-
-            // Initialize the found status to false so that default is not found
-            tag_found = false;
-            // Search through memory block's associated cache blocks in its cache set
-            for(int cache_block_offset=0; cache_block_offset < assoc_deg; cache_block_offset++){
-                // Add cache set offset to global cache offset
-                cache_block_idx = ops[i].cache_block_start + cache_block_offset;
-                //printf("Cache Block: %d,  Cache Tag: %s\n", cache_block_idx, cache_blocks[cache_block_idx].tag.c_str());
-
-                // If the main memory address tag and cache tag match
-                if(ops[i].tag == cache_blocks[cache_block_idx].tag){
-                    //printf("Tag match found!\n");
-                    tag_found = true; // Set found flag to true
-                    ops[i].result = "hit"; // Set operation result as hit
-
-                    // If the operation was a write
-                    if(ops[i].op_type == 'W' || ops[i].op_type == 'w'){
-                        //printf("Writing dirty bit!\n");
-                        // Set cache block dirty flag to true
-                        cache_blocks[cache_block_idx].dirty = true;
-                    }
-                    break; // Break out of cache block search loop
-                }
+            long long index = first_index + i; // Trace index of the operation
+            if(index % sample_every != 0 || (misses_only && ops[i].result != RESULT_MISS))
+                continue;
+            if(format == RESULTS_BIN){
+                uint64_t record[2] = {(uint64_t)index, ((uint64_t)ops[i].mem_address << 2) |
+                                      ((uint64_t)(ops[i].op_type == 'W' || ops[i].op_type == 'w') << 1) | (uint64_t)(ops[i].result == RESULT_HIT)};
+                append((const char*)record, sizeof(record));
+            }else{
+                char row[128]; // Formatted CSV row
+                int row_len = snprintf(row, sizeof(row), "%lld,%c,%llu,%llu,%d,%s\n", index, ops[i].op_type, (unsigned long long)ops[i].mem_address,
+                                       (unsigned long long)ops[i].mem_block, ops[i].cache_set, result_string(ops[i].result));
+                append(row, row_len);
             }
+        }
+    }
 
-            // If the desired main memory tag was not found in cache
-            // Find LRU or FIFO block to overwrite. => Miss
-            if(!tag_found){
-                int cache_block_to_edit = -1; // Initialize cache block to edit to impossible value
-                ops[i].result = "miss"; // Set operation result to miss
+    // Writes any buffered output and closes the file
+    void close_stream(){
+        if(file == NULL)
+            return;
+        flush();
+        fclose(file);
+        file = NULL;
+    }
 
-                // Check to see if the cache set has a block that has not
-                // been written to this simulator execution run.
-                // Did not want to include this in above loop just incase there
-                // could be some edgecase where blocks would not be filled sequentially
-                for(int cache_block_offset=0; cache_block_offset < assoc_deg; cache_block_offset++){
-                    // Add cache set offset to global cache offset
-                    cache_block_idx = ops[i].cache_block_start + cache_block_offset;
-                    // If the cache block is unyet written to, make that block the one to operate on
-                    if(cache_blocks[cache_block_idx].tag.at(0) == 'x'){
-                        cache_block_to_edit = cache_block_idx;
-                        //printf("Empty cache block found: %d", cache_block_idx);
-                        break; // Break out of cache block search loop
-                    }
-                }
+private:
+    void append(const char* bytes){ append(bytes, strlen(bytes)); }
+    void append(const char* bytes, size_t num_bytes){
+        buffer.insert(buffer.end(), bytes, bytes + num_bytes);
+        if(buffer.size() >= BUFFER_BYTES)
+            flush();
+    }
+    void flush(){
+        fwrite(buffer.data(), 1, buffer.size(), file);
+        buffer.clear();
+    }
+};
 
-                // If no 'empty' cache blocks were found, use replacement policy as given by user
-                if(cache_block_to_edit < 0){
-                    bool cache_repl_block_found = false; // Initialize found status to false
-                    int cur_search_main_block; // Store current main memory block searched for
-
-                    // If using least recently used replacement policy
-                    if(replace_policy == 'L' || replace_policy == 'l'){
-                        bool cache_block_age_found; // Variable to store whether or not the cache block age found
-                        int cache_blocks_age[assoc_deg]; // Array of cache set blocks ages
-                        // Iterate through current cache set blocks
-                        for(int cache_block_offset=0; cache_block_offset < assoc_deg; cache_block_offset++){
-                            // Initialize that the current cache block of interest's age has not been found
-                            cache_block_age_found = false;
-                            // Add cache set offset to global cache offset
-                            cache_block_idx = ops[i].cache_block_start + cache_block_offset;
-
-                            // Iterate backwards through memory operations starting at current operation
-                            for(int search_op=i; search_op > 0; search_op--){
-                                //printf("LRU Search op idx: %d", search_op);
-                                // If the historical operated data block and the current cache block
-                                // searched for match
-                                if(ops[search_op].mem_block == cache_blocks[cache_block_idx].data){
-                                    // Set the associated cache block age to the difference in operation index
-                                    // of the current executed operation and the operation the main memory block
-                                    // was last operated on
-                                    cache_blocks_age[cache_block_offset] = i - search_op;
-                                    // Break out of search operation loop
-                                    break;
-                                }
-                                
-                            }
-                        } // End cache block search loop
-                        
-                        int max_age = cache_blocks_age[0]; // Initialize max age to first cache block age
-                        int max_age_cache_offset = 0; // Initialize max age index to 0
-                        // Iterate through cache block ages to find the index (cache set offset)
-                        // of the maximum element of the cache block age
-                        for(int idx=1; idx < assoc_deg; idx++){
-                            // If the current block's age is greater than max age
-                            if(cache_blocks_age[idx] > max_age){
-                                // Set max age to current block's age
-                                max_age = cache_blocks_age[idx];
-                                // Set max age index to current index
-                                max_age_cache_offset = idx;
-                            }
-                        }
-                        // Set cache block to overwrite to
-                        // the cache block with index of max age
-                        cache_block_to_edit = ops[i].cache_block_start + max_age_cache_offset;
-                    }
+/**************************************************************************************
+Function name:         run_simulate(int argc, char *argv[])
+Input parameters:      Integer argc, argv: The command line, "--simulate" followed by
+                           "--<option> <value>" pairs: --trace <file>,
+                           --config <cache>:<line>:<assoc>:<policy>, --mem <bytes>,
+                           --write back|through, --allocate yes|no, --ops-out <file>,
+                           --ops-format csv|bin, --sample-every <n>, --misses-only yes|no,
+                           --classify <CSV prefix> (3C miss classification, per set counters
+                           and reuse distance histogram, see missClassifier),
+                           --restore <checkpoint> (continue a saved simulation, which supplies
+                           the configuration), --reset-stats yes|no (after restoring, count only
+                           this trace segment, e.g. to reuse a warmed-up cache),
+                           --checkpoint <file> (save the simulation at the end of the trace)
+Return value:          Integer: The program exit status
+Purpose:               Summary-only mode. Simulates one cache configuration like the
+                       interactive mode but prints only the summary: no operation table
+                       and no final cache contents. Per-operation results can instead be
+                       streamed (sampled) to a file
+**************************************************************************************/
+int run_simulate(int argc, char *argv[]){
+    MemorySim mem_sim = MemorySim(); // Simulator of the configuration
+    resultStream results; // Per-operation result stream, if requested
+    string results_filename; // File to stream per-operation results to
+    string classify_prefix; // Prefix of the miss classification CSV files, if requested
+    string restore_filename, checkpoint_filename; // Checkpoints to continue from and to save
+    bool reset_stats = false; // Whether to zero the restored counters
+    cacheMemory cache; // Cache of the configuration
+    hitStats stats; // Hit statistics over the whole trace
+    mem_sim.size_main_mem = 1 << 30;
+    mem_sim.size_cache = 0;
 
-                    // If using first-in-first-out replacement policy
-                    else if(replace_policy == 'F' || replace_policy == 'f'){
-                        // Iterate forwards through memory operations 
-                        for(int search_op=0; search_op < num_ops; search_op++){
-                            //printf("FIFO Search op idx: %d", search_op);
-                            // For every search operation in history, see if the main memory
-                            // block is in the cache set of interest
-                            cur_search_main_block = ops[search_op].mem_block;
-                            for(int cache_block_offset=0; cache_block_offset < assoc_deg; cache_block_offset++){
-                                // Add cache set offset to global cache offset
-                                cache_block_idx = ops[i].cache_block_start + cache_block_offset;
-                                // If the cache set contains the historical
-                                // main memory block operated on of interest
-                                if(cache_blocks[cache_block_idx].data == cur_search_main_block){
-                                    cache_repl_block_found = true; // Set replace block found
-                                    // Set replace index to current index
-                                    cache_block_to_edit = cache_block_idx; 
-                                    //printf("FIFO cache block found: %d", cache_block_idx);
-                                    break; // Break out cache block search
-                                }
-                            }
-                            // If a cache block to replace has been found,
-                            // exit search for loop
-                            if(cache_repl_block_found)
-                                break;
-                        }
-                    }
-                    // If invalid replacement policy
-                    // should NOT happen since in 487
-                    else{
-                        printf("---Invalid replacement policy!---\n");
-                    }
-                }
+    // Parse the "--option value" pairs of the command line
+    for(int i=2; i < argc; i += 2){
+        string key = argv[i]; // Option name
+        string value = (i + 1 < argc) ? argv[i + 1] : ""; // Option value
+        bool valid = i + 1 < argc; // Whether the option is valid
+        if(valid && key == "--trace"){
+            mem_sim.input_filename = value;
+        }else if(valid && key == "--config"){
+            valid = sscanf(value.c_str(), "%d:%d:%d:%c", &mem_sim.size_cache, &mem_sim.size_line, &mem_sim.assoc_deg,
+                           &mem_sim.replace_policy) == 4;
+            mem_sim.replace_policy = (char)toupper(mem_sim.replace_policy);
+        }else if(valid && key == "--mem"){
+            valid = from_chars(value.data(), value.data() + value.size(), mem_sim.size_main_mem).ec == errc();
+        }else if(valid && key == "--write"){
+            valid = (value == "back" || value == "through");
+            mem_sim.write_back = (value == "back");
+        }else if(valid && key == "--allocate"){
+            valid = (value == "yes" || value == "no");
+            mem_sim.write_allocate = (value == "yes");
+        }else if(valid && key == "--ops-out"){
+            results_filename = value;
+        }else if(valid && key == "--ops-format"){
+            valid = (value == "csv" || value == "bin");
+            results.format = (value == "bin") ? RESULTS_BIN : RESULTS_CSV;
+        }else if(valid && key == "--sample-every"){
+            valid = from_chars(value.data(), value.data() + value.size(), results.sample_every).ec == errc() && results.sample_every > 0;
+        }else if(valid && key == "--misses-only"){
+            valid = (value == "yes" || value == "no");
+            results.misses_only = (value == "yes");
+        }else if(valid && key == "--classify"){
+            classify_prefix = value;
+        }else if(valid && key == "--restore"){
+            restore_filename = value;
+        }else if(valid && key == "--checkpoint"){
+            checkpoint_filename = value;
+        }else if(valid && key == "--reset-stats"){
+            valid = (value == "yes" || value == "no");
+            reset_stats = (value == "yes");
+        }else{
+            valid = false;
+        }
+        if(!valid){
+            printf("---Invalid simulate option %s %s!---\n", key.c_str(), value.c_str());
+            return 1;
+        }
+    }
+    // A restored simulation brings its own configuration and state
+    if(!restore_filename.empty()){
+        if(mem_sim.size_cache > 0){
+            printf("---A restored simulation takes its configuration from the checkpoint!---\n");
+            return 1;
+        }
+        if(!load_checkpoint(restore_filename, mem_sim, cache, stats))
+            return 1;
+        if(reset_stats){
+            mem_sim.num_hits = 0;
+            mem_sim.traffic = memTraffic();
+            stats.num_ops = 0;
+            stats.num_possible_hits = 0;
+        }
+    }
+    if(mem_sim.input_filename.empty() || mem_sim.size_main_mem == 0 || mem_sim.size_cache <= 0 || mem_sim.size_line <= 0 || mem_sim.assoc_deg <= 0 ||
+       mem_sim.size_cache < mem_sim.size_line * mem_sim.assoc_deg || mem_sim.size_cache % (mem_sim.size_line * mem_sim.assoc_deg) != 0 ||
+       !valid_policy(mem_sim.replace_policy, mem_sim.assoc_deg)){
+        printf("---Simulate needs --trace and a valid --config!---\n");
+        return 1;
+    }
+    if(!checkpoint_filename.empty() && mem_sim.replace_policy == 'O'){
+        printf("---OPT simulations cannot be checkpointed, they need the whole trace!---\n");
+        return 1;
+    }
+    if(!results_filename.empty() && !results.open_stream(results_filename)){
+        printf("---Unable to open result file %s!---\n", results_filename.c_str());
+        return 1;
+    }
+    mem_sim.calc_mem_addr_layout();
+    cout << endl;
 
-                // Execute memory operation on given block (empty or otherwise)
+    if(restore_filename.empty())
+        init_cache(cache, mem_sim.size_cache / mem_sim.size_line / mem_sim.assoc_deg, mem_sim.assoc_deg, mem_sim.replace_policy);
+    // The trace is streamed, except for OPT which needs the whole trace for the next uses
+    traceReader trace; // Reader of the streamed trace
+    traceRecords records; // Whole trace, loaded for the OPT policy
+    vector<long long> next_use; // Next-use index of the loaded trace
+    bool use_opt = (mem_sim.replace_policy == 'O');
+    if(use_opt ? !load_trace_records(mem_sim.input_filename, records) : !trace.open_trace(mem_sim.input_filename)){
+        if(!use_opt)
+            printf("---Unable to open input file %s!---\n", mem_sim.input_filename.c_str());
+        return 1;
+    }
+    if(use_opt)
+        build_next_use(records, mem_sim.size_line, next_use);
+    // Miss classification and per set counters, if requested
+    unique_ptr<missClassifier> classifier; // Miss classifier run alongside the simulation
+    setCounters set_counters; // Per cache set counters
+    if(!classify_prefix.empty()){
+        classifier.reset(new missClassifier(mem_sim.size_cache, mem_sim.size_line));
+        set_counters.init(cache.num_sets);
+        mem_sim.set_counters = &set_counters;
+    }
 
-                // Set cache block to valid
-                cache_blocks[cache_block_to_edit].valid = true; 
-                // Set cache block tag to main memory address tag
-                cache_blocks[cache_block_to_edit].tag   = ops[i].tag; 
-                // Set cache block data to main memory block number
-                cache_blocks[cache_block_to_edit].data  = ops[i].mem_block; 
-                // If operation is a write
-                if(ops[i].op_type == 'W' || ops[i].op_type == 'w'){
-                    //printf("Writing dirty bit!\n");
-                    // Set cache block dirty flag to true
-                    cache_blocks[cache_block_idx].dirty = true;
-                }// Else dirty bit is false (read operation)
-                else{
-                    cache_blocks[cache_block_to_edit].dirty = false;
-                }
-            }            
+    vector<memOp> operations(TRACE_BATCH_SIZE); // Batch of memory operations
+    int num_batch_ops; // Number of memory operations in the current batch
+    while(true){
+        long long first_index = mem_sim.access_clock; // Trace index of the batch's first operation
+        if(use_opt){
+            num_batch_ops = (int)min((size_t)TRACE_BATCH_SIZE, records.size() - (size_t)first_index);
+            records.unpack(first_index, num_batch_ops, operations.data());
+        }else{
+            num_batch_ops = trace.next_batch(operations.data(), TRACE_BATCH_SIZE);
         }
+        if(num_batch_ops == 0)
+            break; // End of trace
+        mem_sim.decode_ops(operations.data(), num_batch_ops);
+        if(use_opt){
+            for(int i=0; i < num_batch_ops; i++)
+                operations[i].next_use = next_use[first_index + i];
+        }
+        mem_sim.exec_ops(operations.data(), num_batch_ops, cache);
+        tally_hit_rates(operations.data(), num_batch_ops, stats);
+        results.write_ops(operations.data(), num_batch_ops, first_index);
+        if(classifier)
+            classifier->classify_ops(operations.data(), num_batch_ops);
+    }
+    results.close_stream();
+
+    // Print only the summary
+    stats.num_hits = mem_sim.num_hits;
+    calc_hit_rates(stats);
+    display_traffic(mem_sim.traffic, mem_sim.size_line);
+    if(classifier){
+        classifier->report(set_counters);
+        if(!classifier->write_csv(classify_prefix, set_counters))
+            return 1;
     }
+    // Save the simulation so a later run can continue it
+    if(!checkpoint_filename.empty() && !save_checkpoint(checkpoint_filename, mem_sim, cache, stats))
+        return 1;
+    return 0;
+}
+
+/*
+    Trace generator specification structure
+
+Members:
+    String pattern: The access pattern: "sequential", "strided", "random", "zipf",
+        "pointer-chase" or "matrix"
+    Long num_refs: The number of references to generate (matrix: at most this many)
+    Long seed: The random number generator seed
+    Integer footprint: The bytes of memory the references fall in
+    Integer stride: The bytes between consecutive references (strided)
+    Integer elem_size: The bytes of one random, Zipfian or pointer-chase element
+    Double write_ratio: The fraction of references that are writes (not matrix)
+    Double zipf_alpha: The Zipf exponent, element k is referenced with weight 1/k^alpha
+    Integer matrix_dim: The dimension of the square matrices (matrix)
+    Integer tile_dim: The tile dimension of the tiled multiplication (matrix)
+*/
+struct genSpec{
+    string pattern;
+    long long num_refs = 1000000;
+    long long seed = 1;
+    int footprint = 1 << 20;
+    int stride = WORD_BYTES;
+    int elem_size = 64;
+    double write_ratio = 0.0;
+    double zipf_alpha = 1.0;
+    int matrix_dim = 128;
+    int tile_dim = 16;
 };
 
 /**************************************************************************************
-    Function name:         display_ops(memOp ops[], int num_ops, int assoc_deg)
-    Input parameters:      memOp ops[]: The array of memory operations to be executed
-                           integer num_ops: The number of memory operations
-                           integer assoc_deg: The cache set association degree
-    Return value:          Void - Returns nothing
-    Purpose:               Displays the memory operations' information and result to the user
+Function name:         generate_trace(const genSpec &spec, traceRecords &records)
+Input parameters:      genSpec spec: The trace to generate
+                       traceRecords records: Filled with the generated memory references
+Return value:          Boolean: Whether the pattern and its parameters were valid
+Purpose:               Generates a synthetic trace. Every pattern is reproducible from its seed:
+                           sequential/strided: addresses 0, stride, 2 * stride, ... wrapping
+                               around the footprint, the stride is one word for sequential
+                           random: uniformly random elements of the footprint
+                           zipf: elements of the footprint with Zipfian popularity, ranked
+                               in a random order so popular elements are scattered
+                           pointer-chase: a walk of one random cycle through every element
+                               (each element holds the next one's address)
+                           matrix: C += A * B with n x n matrices of words, tiled, reading A
+                               and B and writing C once per inner tile loop
 **************************************************************************************/
-void display_ops(memOp ops[], int num_ops, int assoc_deg){
-    // String variable to store each memory addresses potential cache memory blocks
-    string cache_blocks;
-    // Display memory operation table header
-    cout << "\n\nmain memory address\tmm blk #\tcm set #\tcm blk #\thit/miss" << endl;
-    cout << "-----------------------------------------------------------------------------------" << endl;
-    // Iterate through memory operations
-    for(int i=0; i < num_ops; i++){
-        // Initialize cache blocks display string to the starting cache set block number
-        cache_blocks = to_string(ops[i].cache_block_start);
-        // If the degree of association is 2, use 'or' when displaying cache blocks
-        if(assoc_deg == 2){
-            cache_blocks.append(" or " + to_string(ops[i].cache_block_start + assoc_deg - 1));
-        // Else if association degree is greater than 2, use '-' (scales better)
-        }else if(assoc_deg > 2){
-            cache_blocks.append(" - " + to_string(ops[i].cache_block_start + assoc_deg - 1));
+bool generate_trace(const genSpec &spec, traceRecords &records){
+    mt19937_64 rng(spec.seed); // Random number generator of the trace
+    uniform_real_distribution<double> unit(0.0, 1.0); // Uniform [0, 1) for write decisions
+    int num_elems = spec.footprint / max(1, spec.elem_size); // Number of elements in the footprint
+    records.clear();
+    if(spec.num_refs < 0 || spec.footprint <= 0 || spec.stride <= 0 || spec.elem_size <= 0)
+        return false;
+    // Adds a reference, a write with probability write_ratio
+    auto add_ref = [&](long long mem_address){
+        records.push_back(spec.write_ratio > 0.0 && unit(rng) < spec.write_ratio ? 'W' : 'R', (uint64_t)mem_address);
+    };
+
+    if(spec.pattern == "sequential" || spec.pattern == "strided"){
+        int stride = (spec.pattern == "sequential") ? WORD_BYTES : spec.stride; // Bytes between references
+        for(long long i=0; i < spec.num_refs; i++)
+            add_ref(i * stride % spec.footprint);
+    }else if(spec.pattern == "random"){
+        if(num_elems <= 0)
+            return false;
+        uniform_int_distribution<int> elem_dist(0, num_elems - 1); // Uniform element number
+        for(long long i=0; i < spec.num_refs; i++)
+            add_ref((long long)elem_dist(rng) * spec.elem_size);
+    }else if(spec.pattern == "zipf"){
+        if(num_elems <= 0)
+            return false;
+        // Cumulative popularity of the ranks, sampled by binary search
+        vector<double> cdf(num_elems); // Cumulative weight of ranks 1..k
+        double total = 0.0; // Sum of all weights
+        for(int k=0; k < num_elems; k++){
+            total += 1.0 / pow(k + 1, spec.zipf_alpha);
+            cdf[k] = total;
         }
-        // Print formatted display of memory operation information
-        printf("%8d %20d %15d %17s %14s\n", ops[i].mem_address, ops[i].mem_block, ops[i].cache_set, cache_blocks.c_str(), ops[i].result.c_str());
+        vector<int> rank_elem(num_elems); // Element of each popularity rank
+        for(int k=0; k < num_elems; k++)
+            rank_elem[k] = k;
+        shuffle(rank_elem.begin(), rank_elem.end(), rng);
+        for(long long i=0; i < spec.num_refs; i++){
+            int rank = (int)(lower_bound(cdf.begin(), cdf.end(), unit(rng) * total) - cdf.begin());
+            add_ref((long long)rank_elem[min(rank, num_elems - 1)] * spec.elem_size);
+        }
+    }else if(spec.pattern == "pointer-chase"){
+        if(num_elems <= 1)
+            return false;
+        // Sattolo's shuffle gives a single cycle through every element
+        vector<int> next_elem(num_elems); // Element each element points to
+        for(int k=0; k < num_elems; k++)
+            next_elem[k] = k;
+        for(int k=num_elems - 1; k > 0; k--)
+            swap(next_elem[k], next_elem[uniform_int_distribution<int>(0, k - 1)(rng)]);
+        int elem = 0; // Element being visited
+        for(long long i=0; i < spec.num_refs; i++){
+            add_ref((long long)elem * spec.elem_size);
+            elem = next_elem[elem];
+        }
+    }else if(spec.pattern == "matrix"){
+        int n = spec.matrix_dim, tile = spec.tile_dim; // Matrix and tile dimensions
+        if(n <= 0 || tile <= 0 || 3LL * n * n * WORD_BYTES > INT_MAX)
+            return false;
+        long long a_base = 0, b_base = (long long)n * n * WORD_BYTES, c_base = 2 * b_base; // Matrix base addresses
+        // Tiled loops, stopping once num_refs references are generated
+        for(int ii=0; ii < n; ii += tile)
+        for(int jj=0; jj < n; jj += tile)
+        for(int kk=0; kk < n; kk += tile)
+        for(int i=ii; i < min(ii + tile, n); i++)
+        for(int j=jj; j < min(jj + tile, n); j++){
+            for(int k=kk; k < min(kk + tile, n); k++){
+                if((long long)records.size() + 2 > spec.num_refs)
+                    return true;
+                records.push_back('R', a_base + ((long long)i * n + k) * WORD_BYTES);
+                records.push_back('R', b_base + ((long long)k * n + j) * WORD_BYTES);
+            }
+            if((long long)records.size() + 1 > spec.num_refs)
+                return true;
+            records.push_back('W', c_base + ((long long)i * n + j) * WORD_BYTES);
+        }
+    }else{
+        return false; // Unknown pattern
     }
+    return true;
 }
+
 /**************************************************************************************
-Function name:         parse_tag(int mem_address, int num_address_lines, int num_tag_bits)
-Input parameters:      Integer mem_address: The main memory address as an integer
-                       Integer num_address_lines: The number of system address lines/bits
-                       Integer num_tag_bits: The number of tag bits in a main memory address
-Return value:          String tag_string: The tag string representation
-Purpose:               Creates and returns the string representation of the main memory address tag
-***************************************************************************************/
-string parse_tag(int mem_address, int num_address_lines, int num_tag_bits){
-    string tag_string = ""; // Variable to store string representation of tag
-    // Shift the main memory address bits right by the number of
-    // offset and index bits
-    mem_address = mem_address >> (num_address_lines - num_tag_bits);
-    // Iterate through the tag bits of the main memory address
-    for(int bit=1; bit <= num_tag_bits; bit++){
-        // If the current tag bit of interest (masked with 1)
-        // is 1
-        if((mem_address & 0x1) == 1){
-            tag_string.insert(0, "1"); // Add to "1" tag string
-        }else{ // Else if current tag bit is 0, add "0" to tag string
-            tag_string.insert(0, "0");
-        }
-        // Shift the main memory address bits right by 1 digit
-        mem_address = mem_address >> 1;
+Function name:         write_trace_records(string filename, const traceRecords &records, int format)
+Input parameters:      String filename: The trace file to write
+                       traceRecords records: The memory references
+                       Integer format: The trace file format (traceFormat)
+Return value:          Boolean: Whether the trace file was written
+Purpose:               Writes memory references as a text or binary trace file
+**************************************************************************************/
+bool write_trace_records(string filename, const traceRecords &records, int format){
+    FILE* trace_file = fopen(filename.c_str(), "wb");
+    if(trace_file == NULL){
+        printf("---Unable to open output file %s!---\n", filename.c_str());
+        return false;
     }
-    // Return the tag string representation
-    return tag_string;
+    if(format == TRACE_TEXT){
+        // Count line, blank line, then one "R|W address" line per reference
+        fprintf(trace_file, "%zu\n\n", records.size());
+        for(size_t ref=0; ref < records.size(); ref++)
+            fprintf(trace_file, "%c %llu\n", records.is_write(ref) ? 'W' : 'R', (unsigned long long)records.addresses[ref]);
+    }else{
+        binTraceHeader header; // Header of the binary trace
+        vector<memOp> operations(TRACE_BATCH_SIZE); // Batch of references being encoded
+        vector<unsigned char> out_buf; // Encoded records of the batch
+        uint64_t prev_address = 0; // Previous address for delta encoding
+        memcpy(header.magic, BIN_TRACE_MAGIC, sizeof(header.magic));
+        header.version = BIN_TRACE_VERSION;
+        header.encoding = format;
+        header.num_records = records.size();
+        fwrite(&header, sizeof(header), 1, trace_file);
+        for(size_t base=0; base < records.size(); base += TRACE_BATCH_SIZE){
+            int num_batch_ops = (int)min((size_t)TRACE_BATCH_SIZE, records.size() - base); // References in the batch
+            records.unpack(base, num_batch_ops, operations.data());
+            out_buf.clear();
+            encode_records(operations.data(), num_batch_ops, format, prev_address, out_buf);
+            fwrite(out_buf.data(), 1, out_buf.size(), trace_file);
+        }
+    }
+    fclose(trace_file);
+    return true;
 }
+
 /**************************************************************************************
-Function name:         display_cache(cacheBlock cache_blocks[], int num_cache_blocks, int num_tag_bits)
-Input parameters:      cacheBlock cache_blocks[]: The array of cache blocks emulating cache memory
-                       Integer num_cache_blocks: The number of cache blocks in the system cache
-                       Integer num_tag_bits: The number of tag bits in a main memory address
-Return value:          void - Returns nothing
-Purpose:               Displays the status of the system cache
-***************************************************************************************/
-void display_cache(cacheBlock cache_blocks[], int num_cache_blocks, int num_tag_bits){
-    string data_string; // Variable to store the string representation of the cache data
-    cout << "\n\nFinal \"status\" of the cache:" << endl;
-    // Display cache table header
-    cout << "Cache blk #\tdirty bit\tvalid bit\ttag\t\tData" << endl;
-    cout << "------------------------------------------------------------------------------" << endl;
-    // Iterate through cache blocks in cache
-    for(int i=0; i < num_cache_blocks; i++){
-        // Create string representation of cache data
-        data_string = (cache_blocks[i].data < 0) ? "xxx" : "mm blk # " + to_string(cache_blocks[i].data);
-        // Display single cache block information
-        printf("%7d %14d %15d %12s %16s\n", i, cache_blocks[i].dirty, cache_blocks[i].valid, cache_blocks[i].tag.c_str(), data_string.c_str());
+Function name:         parse_gen_option(genSpec &spec, string key, string value)
+Input parameters:      genSpec spec: The trace generator specification to update
+                       String key: The option name (command line flag without "--")
+                       String value: The option value
+Return value:          Boolean: Whether the option was valid
+Purpose:               Applies one trace generator option. Options are: pattern, refs, seed,
+                       footprint, stride, elem, writes, alpha, matrix, tile (see genSpec)
+**************************************************************************************/
+bool parse_gen_option(genSpec &spec, string key, string value){
+    const char* first = value.data(); // Start of the value
+    const char* last = value.data() + value.size(); // End of the value
+    if(key == "pattern"){
+        spec.pattern = value;
+        return true;
+    }else if(key == "refs"){
+        return from_chars(first, last, spec.num_refs).ec == errc();
+    }else if(key == "seed"){
+        return from_chars(first, last, spec.seed).ec == errc();
+    }else if(key == "footprint"){
+        return from_chars(first, last, spec.footprint).ec == errc();
+    }else if(key == "stride"){
+        return from_chars(first, last, spec.stride).ec == errc();
+    }else if(key == "elem"){
+        return from_chars(first, last, spec.elem_size).ec == errc();
+    }else if(key == "writes"){
+        return sscanf(value.c_str(), "%lf", &spec.write_ratio) == 1;
+    }else if(key == "alpha"){
+        return sscanf(value.c_str(), "%lf", &spec.zipf_alpha) == 1;
+    }else if(key == "matrix"){
+        return from_chars(first, last, spec.matrix_dim).ec == errc();
+    }else if(key == "tile"){
+        return from_chars(first, last, spec.tile_dim).ec == errc();
     }
+    return false; // Unknown option
 }
+
 /**************************************************************************************
-Function name:         init_cache(cacheBlock cache_blocks[], int num_cache_blocks, int num_tag_bits)
-Input parameters:      cacheBlock cache_blocks[]: The array of cache blocks emulating cache memory
-                       Integer num_cache_blocks: The number of cache blocks in the system cache
-                       Integer num_tag_bits: The number of tag bits in a main memory address
-Return value:          void - Returns nothing
-Purpose:               Initializes the system cache
+Function name:         run_generate(int argc, char *argv[])
+Input parameters:      Integer argc, argv: The command line, "--generate" followed by
+                           "--<option> <value>" pairs: --out <file>,
+                           --format text|fixed|delta and the parse_gen_option options
+Return value:          Integer: The program exit status
+Purpose:               Writes a synthetic trace file
 **************************************************************************************/
-void init_cache(cacheBlock cache_blocks[], int num_cache_blocks, int num_tag_bits){
-    // Iterate through the cache blocks
-    for(int i=0; i < num_cache_blocks; i++){
-        // Initialize cache dirty and valid statuses to be false
-        cache_blocks[i].dirty = false;
-        cache_blocks[i].valid = false;
-        // Set cache block tag to be the correct length but filled with 'x's
-        cache_blocks[i].tag   = string(num_tag_bits, 'x');
-        // Initialize the cache data block to be an impossible value
-        cache_blocks[i].data  = -1;
+int run_generate(int argc, char *argv[]){
+    genSpec spec; // Trace to generate
+    string out_filename; // Trace file to write
+    int format = TRACE_TEXT; // Trace file format
+    traceRecords records; // Generated references
+
+    // Parse the "--option value" pairs of the command line
+    for(int i=2; i < argc; i += 2){
+        string key = argv[i]; // Option name
+        string value = (i + 1 < argc) ? argv[i + 1] : ""; // Option value
+        bool valid = i + 1 < argc && key.rfind("--", 0) == 0; // Whether the option is valid
+        if(valid && key == "--out"){
+            out_filename = value;
+        }else if(valid && key == "--format"){
+            valid = (value == "text" || value == "fixed" || value == "delta");
+            format = (value == "fixed") ? TRACE_BIN_FIXED : (value == "delta") ? TRACE_BIN_DELTA : TRACE_TEXT;
+        }else if(valid){
+            valid = parse_gen_option(spec, key.substr(2), value);
+        }
+        if(!valid){
+            printf("---Invalid generate option %s %s!---\n", key.c_str(), value.c_str());
+            return 1;
+        }
+    }
+    if(out_filename.empty() || !generate_trace(spec, records)){
+        printf("---Generate needs --out and a valid --pattern!---\n");
+        return 1;
     }
+    if(!write_trace_records(out_filename, records, format))
+        return 1;
+    printf("Generated %zu %s memory references into %s\n", records.size(), spec.pattern.c_str(), out_filename.c_str());
+    return 0;
 }
+
+/*
+    Benchmark result structure: the speed of one workload, associativity and
+    policy combination
+
+Members:
+    String workload: The generated workload pattern
+    Integer assoc_deg: The degree of association of the cache
+    Character replace_policy: The cache replacement policy
+    Double ns_per_access: The best time per reference of the execute phase (the
+        simulator kernel) over the repetitions, compared against the baseline
+    Double total_ns_per_access: The best time per reference of the whole simulation,
+        including unpacking and decoding the trace
+*/
+struct benchResult{
+    string workload;
+    int assoc_deg;
+    char replace_policy;
+    double ns_per_access;
+    double total_ns_per_access;
+};
+
 /**************************************************************************************
-    Function name:         calc_hit_rates(memOp ops[], int num_ops)
-    Input parameters:      memOp ops[]: The array of memory operations to be executed
-                           integer num_ops: The number of memory operations
-    Return value:          Void - Returns nothing
-    Purpose:               Calculates and displays the memory operation optimum and actual hit rates
+Function name:         run_bench(int argc, char *argv[])
+Input parameters:      Integer argc, argv: The command line, "--bench" followed by
+                           "--<option> <value>" pairs: --refs <n>, --cache <bytes>,
+                           --line <bytes>, --assoc <list>, --policy <L,F,O,P,S,B,R,U>,
+                           --reps <n>, --save <baseline file>, --baseline <baseline file>,
+                           --tolerance <percent>
+Return value:          Integer: The program exit status, 2 if any result is slower than
+                       the baseline by more than the tolerance
+Purpose:               Throughput benchmark of the simulator core. Simulates generated
+                       sequential, uniform random and Zipfian workloads for every
+                       associativity and policy and reports references/second and
+                       ns/access of the execute phase (exec_ops over a trace decoded
+                       beforehand), the best of several repetitions. The time of the
+                       whole simulate_config, trace unpacking and decoding included, is
+                       reported next to it. Execute phase results can be saved as a
+                       baseline and compared against one (bench_baseline.csv is the
+                       reference baseline of the default options)
 **************************************************************************************/
-void calc_hit_rates(memOp ops[], int num_ops){
-    int num_hits = 0; // Initialize the number of hits to 0
-    // Create a set containing the main memory blocks yet operated on
-    set<int> blocks_seen;
+int run_bench(int argc, char *argv[]){
+    long long num_refs = 1000000; // References per workload
+    int size_cache = 32768, size_line = 64; // Benchmarked cache size and line size
+    vector<int> assoc_degs; // Benchmarked associativities
+    vector<char> policies; // Benchmarked replacement policies
+    int num_reps = 3; // Repetitions per combination, the best is kept
+    double tolerance = 10.0; // Percent slowdown against the baseline reported as a regression
+    string save_filename, baseline_filename; // Baseline files to write and compare against
 
-    // Iterate through memory operations
-    for(int i=0; i < num_ops; i++){
-        // If the current main memory block to be operated on has been seen before
-        if(blocks_seen.find(ops[i].mem_block) != blocks_seen.end()){
-            num_hits++; // Increment the number of hits
-        } 
-        // Else, add the curent main memory block to the seen list
-        else{
-            blocks_seen.insert(ops[i].mem_block);
+    // Parse the "--option value" pairs of the command line
+    for(int i=2; i < argc; i += 2){
+        string key = argv[i]; // Option name
+        string value = (i + 1 < argc) ? argv[i + 1] : ""; // Option value
+        const char* first = value.data(); // Start of the value
+        const char* last = value.data() + value.size(); // End of the value
+        bool valid = i + 1 < argc; // Whether the option is valid
+        if(valid && key == "--refs"){
+            valid = from_chars(first, last, num_refs).ec == errc() && num_refs > 0;
+        }else if(valid && key == "--cache"){
+            valid = from_chars(first, last, size_cache).ec == errc();
+        }else if(valid && key == "--line"){
+            valid = from_chars(first, last, size_line).ec == errc() && size_line > 0;
+        }else if(valid && key == "--assoc"){
+            valid = parse_int_list(value, assoc_degs);
+        }else if(valid && key == "--policy"){
+            for(char policy : value){
+                if(policy != ',')
+                    policies.push_back((char)toupper(policy));
+            }
+        }else if(valid && key == "--reps"){
+            valid = from_chars(first, last, num_reps).ec == errc() && num_reps > 0;
+        }else if(valid && key == "--save"){
+            save_filename = value;
+        }else if(valid && key == "--baseline"){
+            baseline_filename = value;
+        }else if(valid && key == "--tolerance"){
+            valid = sscanf(value.c_str(), "%lf", &tolerance) == 1;
+        }else{
+            valid = false;
+        }
+        if(!valid){
+            printf("---Invalid bench option %s %s!---\n", key.c_str(), value.c_str());
+            return 1;
         }
     }
-    // Calculate and print the optimum hit rate
-    printf("\nHighest possible hit rate = %d/%d = %2.0f%%\n", num_hits, num_ops, (float)num_hits/num_ops*100.0);
+    if(assoc_degs.empty())
+        assoc_degs = {1, 2, 4, 8, 16};
+    if(policies.empty())
+        policies = {'L', 'F', 'O', 'P', 'S', 'B', 'R', 'U'};
 
-    num_hits = 0; // Reset the number of hits for actual calculation
-    // Iterate through the memory operations
-    for(int i=0; i < num_ops; i++){
-        // If the operation resulted in a cache hit
-        if(ops[i].result == "hit")
-            num_hits++; // Increment the number of hits
+    // Read the baseline to compare against, one "workload,assoc,policy,ns_per_access" line per result
+    map<string, double> baseline; // Baseline ns/access of each "workload,assoc,policy"
+    if(!baseline_filename.empty()){
+        ifstream baseline_stream(baseline_filename); // Baseline file
+        string line; // Current line of the file
+        if(!baseline_stream){
+            printf("---Unable to open baseline file %s!---\n", baseline_filename.c_str());
+            return 1;
+        }
+        while(getline(baseline_stream, line)){
+            size_t comma_pos = line.rfind(','); // Separator of the key and the time
+            if(line.empty() || line[0] == '#' || comma_pos == string::npos)
+                continue;
+            baseline[line.substr(0, comma_pos)] = atof(line.c_str() + comma_pos + 1);
+        }
     }
-    // Calculate and print the actual cache hit rate
-    printf("Actual hit rate = %d/%d = %2.0f%%\n", num_hits, num_ops, (float)num_hits/num_ops*100.0);
+
+    // Benchmark every workload, associativity and policy
+    vector<benchResult> results; // Results of every combination
+    bool regression = false; // Whether any result is slower than the baseline allows
+    printf("\n%14s %6s %7s %14s %12s %12s %12s %9s\n", "workload", "assoc", "policy", "refs/s", "ns/access", "total ns", "baseline", "change");
+    cout << "------------------------------------------------------------------------------------------------" << endl;
+    for(string workload : {"sequential", "random", "zipf"}){
+        genSpec spec; // Workload generator specification
+        traceRecords records; // Workload trace
+        map<int, vector<long long>> next_uses; // OPT next-use index, built outside the timing
+        spec.pattern = workload;
+        spec.num_refs = num_refs;
+        spec.footprint = size_cache * 8;
+        spec.write_ratio = 0.3;
+        generate_trace(spec, records);
+        for(int assoc_deg : assoc_degs){
+            for(char policy : policies){
+                if(size_cache < size_line * assoc_deg || size_cache % (size_line * assoc_deg) != 0 || !valid_policy(policy, assoc_deg))
+                    continue;
+                if(policy == 'O' && next_uses.find(size_line) == next_uses.end())
+                    build_next_use(records, size_line, next_uses[size_line]);
+                benchResult result; // Result of this combination
+                result.workload = workload;
+                result.assoc_deg = assoc_deg;
+                result.replace_policy = policy;
+                result.ns_per_access = 0.0;
+                result.total_ns_per_access = 0.0;
+
+                // Decode the whole trace once, outside the timing of the execute phase
+                MemorySim mem_sim = MemorySim(); // Simulator of the combination, before any reference
+                mem_sim.size_main_mem = 1 << 30;
+                mem_sim.size_cache = size_cache;
+                mem_sim.size_line = size_line;
+                mem_sim.assoc_deg = assoc_deg;
+                mem_sim.replace_policy = policy;
+                mem_sim.write_back = true;
+                mem_sim.write_allocate = true;
+                mem_sim.calc_layout();
+                vector<memOp> operations(records.size()); // Decoded trace
+                for(size_t base=0; base < records.size(); base += TRACE_BATCH_SIZE){
+                    int num_batch_ops = (int)min((size_t)TRACE_BATCH_SIZE, records.size() - base);
+                    records.unpack(base, num_batch_ops, &operations[base]);
+                    mem_sim.decode_ops(&operations[base], num_batch_ops);
+                }
+                if(policy == 'O'){
+                    for(size_t i=0; i < records.size(); i++)
+                        operations[i].next_use = next_uses[size_line][i];
+                }
+
+                for(int rep=0; rep < num_reps; rep++){
+                    // Execute phase: the kernel over the decoded trace, in the sweep's batches
+                    MemorySim exec_sim = mem_sim; // Simulator of this repetition
+                    cacheMemory cache; // Cache of this repetition
+                    init_cache(cache, size_cache / size_line / assoc_deg, assoc_deg, policy);
+                    auto start = chrono::steady_clock::now();
+                    for(size_t base=0; base < records.size(); base += TRACE_BATCH_SIZE)
+                        exec_sim.exec_ops(&operations[base], (int)min((size_t)TRACE_BATCH_SIZE, records.size() - base), cache);
+                    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / records.size();
+                    if(rep == 0 || ns < result.ns_per_access)
+                        result.ns_per_access = ns;
+
+                    // Whole simulation, as a sweep runs it
+                    sweepConfig config; // Benchmarked configuration
+                    config.size_cache = size_cache;
+                    config.size_line = size_line;
+                    config.assoc_deg = assoc_deg;
+                    config.replace_policy = policy;
+                    start = chrono::steady_clock::now();
+                    simulate_config(config, 1 << 30, records, policy == 'O' ? &next_uses[size_line] : NULL, 1);
+                    ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / records.size();
+                    if(rep == 0 || ns < result.total_ns_per_access)
+                        result.total_ns_per_access = ns;
+                }
+                results.push_back(result);
+
+                // Compare with the baseline if it has this combination
+                char key[64]; // Baseline key of the combination
+                snprintf(key, sizeof(key), "%s,%d,%c", workload.c_str(), assoc_deg, policy);
+                printf("%14s %6d %7c %14.0f %12.2f %12.2f", workload.c_str(), assoc_deg, policy, 1e9 / result.ns_per_access,
+                       result.ns_per_access, result.total_ns_per_access);
+                auto base = baseline.find(key);
+                if(base != baseline.end() && base->second > 0.0){
+                    double change = (result.ns_per_access / base->second - 1.0) * 100.0; // Percent slower than the baseline
+                    bool slower = change > tolerance; // Whether this is a regression
+                    regression = regression || slower;
+                    printf(" %12.2f %+8.1f%%%s\n", base->second, change, slower ? "  SLOWER" : "");
+                }else{
+                    printf(" %12s %9s\n", "-", "-");
+                }
+            }
+        }
+    }
+
+    // Save the results as the new baseline if requested
+    if(!save_filename.empty()){
+        FILE* save_file = fopen(save_filename.c_str(), "w");
+        if(save_file == NULL){
+            printf("---Unable to open baseline file %s!---\n", save_filename.c_str());
+            return 1;
+        }
+        fprintf(save_file, "# workload,assoc,policy,ns_per_access of the execute phase (%lld refs, %d byte cache, %d byte lines)\n",
+                num_refs, size_cache, size_line);
+        for(const benchResult &result : results)
+            fprintf(save_file, "%s,%d,%c,%.4f\n", result.workload.c_str(), result.assoc_deg, result.replace_policy, result.ns_per_access);
+        fclose(save_file);
+    }
+    if(regression){
+        printf("---Slower than the baseline by more than %.1f%%!---\n", tolerance);
+        return 2;
+    }
+    return 0;
 }
 
+} // namespace memsim
+
+// Library builds (-DMEMSIM_LIBRARY) embed the simulator through cacheSim (memsim.h) instead
+#ifndef MEMSIM_LIBRARY
+using namespace memsim;
+
 int main(int argc, char *argv[]) {
     // Character input to parse for continue operation status
-    char cont_input;
-    // Dummy string for dumping file empty line to
-    string dummy_string;
+    char cont_input = 'n';
+    // Main memory size as typed, validated before use
+    string mem_input;
+
+    // Convert a text trace into a binary trace instead of simulating:
+    //   ece586_lab7 --convert <text trace> <binary trace> [fixed|delta]
+    if(argc >= 4 && string(argv[1]) == "--convert"){
+        int encoding = (argc >= 5 && string(argv[4]) == "delta") ? TRACE_BIN_DELTA : TRACE_BIN_FIXED;
+        return convert_trace(argv[2], argv[3], encoding) ? 0 : 1;
+    }
+    // Summary-only simulation of one configuration, per-operation results optionally streamed to a file:
+    //   ece586_lab7 --simulate --trace <file> --config <cache:line:assoc:policy> [--mem <bytes>]
+    //               [--write back|through] [--allocate yes|no] [--ops-out <file>] [--ops-format csv|bin]
+    //               [--sample-every <n>] [--misses-only yes|no] [--classify <CSV prefix>]
+    //               [--restore <checkpoint>] [--reset-stats yes|no] [--checkpoint <file>]
+    if(argc >= 2 && string(argv[1]) == "--simulate")
+        return run_simulate(argc, argv);
+    // Synthetic trace generator:
+    //   ece586_lab7 --generate --pattern sequential|strided|random|zipf|pointer-chase|matrix --out <file>
+    //               [--format text|fixed|delta] [--refs <n>] [--seed <n>] [--footprint <bytes>] [--stride <bytes>]
+    //               [--elem <bytes>] [--writes <fraction>] [--alpha <zipf exponent>] [--matrix <n>] [--tile <n>]
+    if(argc >= 2 && string(argv[1]) == "--generate")
+        return run_generate(argc, argv);
+    // Simulator throughput benchmark, optionally saved as or compared against a baseline:
+    //   ece586_lab7 --bench [--refs <n>] [--cache <bytes>] [--line <bytes>] [--assoc <list>] [--policy <list>]
+    //               [--reps <n>] [--save <file>] [--baseline <file>] [--tolerance <percent>]
+    if(argc >= 2 && string(argv[1]) == "--bench")
+        return run_bench(argc, argv);
+    // Batch mode configuration sweep instead of the interactive prompts:
+    //   ece586_lab7 --sweep --trace <file> --cache <list> --line <list> --assoc <list> --policy <L,F,O,P,S,B,R,U>
+    //               [--mem <bytes>] [--config <cache:line:assoc:policy>] [--file <sweep config>]
+    //               [--threads <n>] [--shards <n>] [--write back|through] [--allocate yes|no] [--csv <file>]
+    //               [--sample-sets <n>] [--sample-period <refs> --sample-warmup <refs> --sample-window <refs>]
+    if(argc >= 2 && string(argv[1]) == "--sweep")
+        return run_sweep(argc, argv);
+    // LRU miss-ratio curves for every cache size from one pass over the trace:
+    //   ece586_lab7 --stackdist --trace <file> --line <list> [--sets <list>] [--csv <file>]
+    if(argc >= 2 && string(argv[1]) == "--stackdist")
+        return run_stack_distance(argc, argv);
+    // Multi-level cache hierarchy in one pass over the trace:
+    //   ece586_lab7 --hierarchy --trace <file> --level <size:line:assoc:policy[:latency]> [--level ...]
+    //               [--inclusion inclusive|exclusive|nine] [--mem-latency <cycles>]
+    if(argc >= 2 && string(argv[1]) == "--hierarchy")
+        return run_hierarchy(argc, argv);
+    // Multi-core private caches kept coherent over a snooping bus:
+    //   ece586_lab7 --coherence --cache <size:line:assoc:policy> (--trace <core 0 file> --trace <core 1 file> ...
+    //               | --core-trace <file>) [--protocol mesi|moesi]
+    if(argc >= 2 && string(argv[1]) == "--coherence")
+        return run_coherence(argc, argv);
+    // Interactive prompts, optionally also simulating the cache with OPT to show the achievable hit rate
+    // (loads the whole trace and its next-use index, so only done when asked for). The write
+    // policies are options rather than prompts so scripted input only holds the cache geometry:
+    //   ece586_lab7 [--compare-opt] [--write back|through] [--allocate yes|no]
+    bool compare_opt = false; // Whether to also simulate the cache with OPT
+    bool write_back = true; // Write-back (or write-through) write hit policy
+    bool write_allocate = true; // Write-allocate (or no-write-allocate) write miss policy
+    for(int i=1; i < argc; i++){
+        string key = argv[i]; // Option name
+        string value = (i + 1 < argc) ? argv[i + 1] : ""; // Option value
+        if(key == "--compare-opt"){
+            compare_opt = true;
+        }else if(key == "--write" && (value == "back" || value == "through")){
+            write_back = (value == "back");
+            i++;
+        }else if(key == "--allocate" && (value == "yes" || value == "no")){
+            write_allocate = (value == "yes");
+            i++;
+        }else{
+            printf("---Invalid option %s!---\n", key.c_str());
+            return 1;
+        }
+    }
+
     // Infinite operation loop
     while(1){
         // Create memory simulator to later populate with values
@@ -431,71 +4879,125 @@ int main(int argc, char *argv[]) {
 
         // Parse all user input regarding the simulator operation
         cout << "Enter the size of main memory in bytes: ";
-        cin >> mem_sim.size_main_mem;
+        cin >> mem_input;
         cout << "Enter the size of the cache in bytes: ";
         cin >> mem_sim.size_cache;
         cout << "Enter the block/line size: ";
         cin >> mem_sim.size_line;
         cout << "Enter the degree of set-associativity (input n for an n-way set-associative mapping): ";
         cin >> mem_sim.assoc_deg;
-        cout << "Enter the replacement policy (L = LRU, F = FIFO): ";
+        cout << "Enter the replacement policy (L = LRU, F = FIFO, O = OPT, P = tree-PLRU, S = SRRIP, B = BRRIP, R = random, U = LFU): ";
         cin >> mem_sim.replace_policy;
+        mem_sim.replace_policy = toupper(mem_sim.replace_policy);
+        mem_sim.write_back = write_back;
+        mem_sim.write_allocate = write_allocate;
         cout << "Enter the name of the input file containing the list of memory references generated by the CPU:";
         cin >> mem_sim.input_filename;
 
+        // End at the end of the input, and ask again after input that is not a number
+        if(!cin){
+            if(cin.eof())
+                return 0; // End program
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            printf("\n---Invalid input, enter numbers for the sizes and associativity!---\n");
+            continue;
+        }
+        // The memory size is read as text, so negative sizes and sizes of 2^64 and up are refused
+        from_chars_result parsed = from_chars(mem_input.data(), mem_input.data() + mem_input.size(), mem_sim.size_main_mem);
+        if(parsed.ec != errc() || parsed.ptr != mem_input.data() + mem_input.size() || mem_sim.size_main_mem == 0 ||
+           mem_sim.size_line <= 0 || mem_sim.assoc_deg <= 0 ||
+           mem_sim.size_cache < (long long)mem_sim.size_line * mem_sim.assoc_deg ||
+           mem_sim.size_cache % ((long long)mem_sim.size_line * mem_sim.assoc_deg) != 0){
+            printf("\n---Invalid memory or cache size (memory 1 to 2^64 - 1 bytes, cache a multiple of line size * associativity)!---\n");
+            continue;
+        }
+
         // Calculate any other necessary parameters about the simulator operation
         mem_sim.calc_mem_addr_layout();
 
         // Calculate the number of cache blocks
         int num_cache_blocks = mem_sim.size_cache / mem_sim.size_line;
-        // Declare an array of cache blocks representing the system cache
-        cacheBlock cache_blocks[num_cache_blocks];
-        // Initialize the system cache to starting values
-        init_cache(cache_blocks, num_cache_blocks, mem_sim.num_tag_bits);
-
-        // Parse memory operation file
-        std::ifstream input_stream; // Create input file stream
-        int num_mem_ops; // Variable to store number of memory operations
-        input_stream.open(mem_sim.input_filename); // Open memory operations file
-        input_stream >> num_mem_ops; // Get number of memory operations from file
-        memOp operations[num_mem_ops]; // Create array of memory operations
-        
-        getline(input_stream, dummy_string); // Ignore empty line in input file
-
-        char op_char; // Variable to store temporary memory operation type
-        int mem_loc; // Variable to store temporary memory address
-        // Calculate and store number of address lines
-        int num_addr_lines = (int)log2(mem_sim.size_main_mem);
-
-        // Parse input memory operations into operations array
-        for(int i=0; i<num_mem_ops; i++){
-            input_stream >> operations[i].op_type; // Get op type from file
-            input_stream >> operations[i].mem_address; // Get memory address from file
-            // Calculate and set memory operation main memory block
-            operations[i].mem_block = floor(operations[i].mem_address / mem_sim.size_line);
-            // Calculate and set memory operation cache set
-            operations[i].cache_set = operations[i].mem_block % (mem_sim.size_cache / mem_sim.size_line / mem_sim.assoc_deg);
-            // Calculate and set memory operation starting cache block
-            operations[i].cache_block_start = operations[i].cache_set * mem_sim.assoc_deg;
-            // Initialize memory operation result to unknown string
-            operations[i].result = UNKOWN_STR;
-            // Set memory operation address tag
-            operations[i].tag = parse_tag(operations[i].mem_address, num_addr_lines, mem_sim.num_tag_bits);
-        }
+        // Declare the system cache
+        cacheMemory cache;
+        // Allocate the system cache and initialize it to starting values
+        init_cache(cache, num_cache_blocks / mem_sim.assoc_deg, mem_sim.assoc_deg, mem_sim.replace_policy);
+
+        // Open the memory operation file. The trace is streamed, except for the OPT
+        // replacement policy which needs the whole trace up front to know each block's next use
+        traceReader trace; // Reader of the streamed trace
+        traceRecords records; // Whole trace, loaded for the OPT policy
+        vector<long long> next_use; // Next-use index of the loaded trace
+        bool use_opt = (mem_sim.replace_policy == 'O');
+        if(!valid_policy(mem_sim.replace_policy, mem_sim.assoc_deg)){
+            printf("---Invalid replacement policy for this cache!---\n");
+        }else if(use_opt ? load_trace_records(mem_sim.input_filename, records) : trace.open_trace(mem_sim.input_filename)){
+            // Batch of memory operations, reused for every batch of the trace
+            vector<memOp> operations(TRACE_BATCH_SIZE);
+            hitStats stats; // Hit statistics over the whole trace
+            int num_batch_ops; // Number of memory operations in the current batch
+            size_t num_loaded_ops = 0; // Number of loaded memory operations already executed
+            bool first_batch = true; // Whether the table header still has to be printed
+            if(use_opt)
+                build_next_use(records, mem_sim.size_line, next_use);
 
-        
+            // Parse, execute and display the memory operations one batch at a time
+            while(true){
+                // Get the next batch from the loaded trace or from the trace file
+                if(use_opt){
+                    num_batch_ops = (int)min((size_t)TRACE_BATCH_SIZE, records.size() - num_loaded_ops);
+                    records.unpack(num_loaded_ops, num_batch_ops, operations.data());
+                }else{
+                    num_batch_ops = trace.next_batch(operations.data(), TRACE_BATCH_SIZE);
+                }
+                if(num_batch_ops == 0)
+                    break; // End of trace
 
-        // Execute memory operations given the simulator setup and system cache
-        mem_sim.exec_ops(operations, num_mem_ops, cache_blocks, num_cache_blocks);
+                // Calculate the block, cache set and tag of each memory operation
+                mem_sim.decode_ops(operations.data(), num_batch_ops);
+                // Attach the next use of each memory operation's block for OPT
+                if(use_opt){
+                    for(int i=0; i < num_batch_ops; i++)
+                        operations[i].next_use = next_use[num_loaded_ops + i];
+                    num_loaded_ops += num_batch_ops;
+                }
+                // Execute memory operations given the simulator setup and system cache
+                mem_sim.exec_ops(operations.data(), num_batch_ops, cache);
+                // Print table of memory operations and associated information
+                display_ops(operations.data(), num_batch_ops, mem_sim.assoc_deg, first_batch);
+                // Add the batch to the optimum and actual hit counts
+                tally_hit_rates(operations.data(), num_batch_ops, stats);
+                first_batch = false;
+            }
+            trace.close_trace();
 
-        // Print table of memory operations and associated information
-        display_ops(operations, num_mem_ops, mem_sim.assoc_deg);
+            // Simulate the same cache with the OPT policy to show the achievable hit rate
+            if(use_opt){
+                stats.num_opt_hits = mem_sim.num_hits;
+            }else if(compare_opt && load_trace_records(mem_sim.input_filename, records)){
+                sweepConfig opt_config; // This cache with the OPT replacement policy
+                opt_config.size_cache = mem_sim.size_cache;
+                opt_config.size_line = mem_sim.size_line;
+                opt_config.assoc_deg = mem_sim.assoc_deg;
+                opt_config.replace_policy = 'O';
+                opt_config.write_back = mem_sim.write_back;
+                opt_config.write_allocate = mem_sim.write_allocate;
+                build_next_use(records, mem_sim.size_line, next_use);
+                simulate_config(opt_config, mem_sim.size_main_mem, records, &next_use, 1);
+                stats.num_opt_hits = opt_config.num_hits;
+            }
 
-        // Calculate and print the optimum and actual hit rates
-        calc_hit_rates(operations, num_mem_ops);
+            // Calculate and print the optimum and actual hit rates
+            stats.num_hits = mem_sim.num_hits;
+            calc_hit_rates(stats);
+            // Print the bytes moved to and from memory
+            display_traffic(mem_sim.traffic, mem_sim.size_line);
+        }else if(!use_opt){
+            printf("---Unable to open input file %s!---\n", mem_sim.input_filename.c_str());
+        }
 
         // Display final cache status
-        display_cache(cache_blocks, num_cache_blocks, mem_sim.num_tag_bits);
+        display_cache(cache, mem_sim.num_tag_bits);
 
         // Check if user wants to run another memory simulator
         cout << "Continue? (y = yes, n = no): ";
@@ -506,4 +5008,5 @@ int main(int argc, char *argv[]) {
             return 0; // End program
     }
     return 0; // End program operation
-}
\ No newline at end of file
+}
+#endif // MEMSIM_LIBRARY
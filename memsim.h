@@ -0,0 +1,100 @@
+/*  Memory simulator library interface
+
+Drives one simulated cache live from another program (e.g. a binary-instrumentation
+tool or an allocator hook) instead of from a trace file. Build ece586_lab7.cpp with
+MEMSIM_LIBRARY defined (which leaves out main()) into a library, include this header
+in any number of translation units and link against the library:
+    g++ -std=c++17 -O2 -pthread -DMEMSIM_LIBRARY -c ece586_lab7.cpp -o memsim.o
+    ar rcs libmemsim.a memsim.o
+Everything the simulator defines is in the memsim namespace.
+*/
+#ifndef MEMSIM_H
+#define MEMSIM_H
+
+#include <cstdint>
+#include <memory>
+
+namespace memsim {
+
+// Result of a memory operation, one byte per operation instead of a string
+enum opResult : uint8_t { RESULT_UNKNOWN = 0, RESULT_HIT = 1, RESULT_MISS = 2 };
+
+// Bytes accessed by one memory operation. The trace has no access sizes, so
+// every reference is taken to be one 4-byte word (e.g. the bytes of a write-through)
+constexpr int WORD_BYTES = 4;
+
+/*
+    Memory traffic structure: the transfers between a cache and the next
+    level of memory caused by its memory operations
+
+Members:
+    Long num_fills: The number of lines read from memory into the cache
+    Long num_writebacks: The number of dirty lines evicted and written back to memory
+    Long num_write_throughs: The number of writes sent straight to memory (write-through
+        writes and no-write-allocate write misses)
+*/
+struct memTraffic{
+    long long num_fills = 0;
+    long long num_writebacks = 0;
+    long long num_write_throughs = 0;
+
+    // Adds another cache's (or shard's) traffic to this one
+    void add(const memTraffic &other){
+        num_fills += other.num_fills;
+        num_writebacks += other.num_writebacks;
+        num_write_throughs += other.num_write_throughs;
+    }
+    // Total bytes moved between the cache and memory for the given line size
+    long long total_bytes(int size_line) const {
+        return (num_fills + num_writebacks) * size_line + num_write_throughs * WORD_BYTES;
+    }
+};
+
+// Simulator behind a cacheSim, defined in ece586_lab7.cpp
+class onlineSim;
+
+/*
+    Cache Simulator Class
+
+One simulated cache. Every access is decoded and simulated immediately with the
+same kernels as the trace modes. An instance is not thread safe; give every
+thread its own one (see thread_sim)
+*/
+class cacheSim{
+public:
+    cacheSim();
+    ~cacheSim();
+    cacheSim(cacheSim &&other) noexcept;
+    cacheSim &operator=(cacheSim &&other) noexcept;
+
+    // Sets the cache up empty, with cleared statistics. replace_policy is any policy
+    // letter except 'O' (OPT needs the future accesses). Returns whether the
+    // configuration is valid; accesses are refused until one is
+    bool configure(uint64_t size_main_mem, int size_cache, int size_line, int assoc_deg, char replace_policy,
+                   bool write_back = true, bool write_allocate = true);
+    // Simulates one access, returns whether it hit
+    bool access(uint64_t mem_address, bool is_write);
+    // Simulates a buffer of accesses (is_writes NULL if all are reads), storing each
+    // access's opResult in results if given. Returns the number of hits, or -1 if
+    // the simulator is not configured
+    long long access_many(const uint64_t mem_addresses[], const bool is_writes[], int num_addresses,
+                          uint8_t results[] = nullptr);
+
+    // Statistics of the accesses simulated so far
+    long long num_hits() const;
+    long long num_misses() const;
+    memTraffic traffic() const;
+    // Clears the statistics, keeping the cache contents (e.g. after a warm-up)
+    void reset_stats();
+
+private:
+    std::unique_ptr<onlineSim> sim;
+};
+
+// Per thread simulator for hooks that run on many threads, so they need no
+// locking. Each thread must configure its instance before use
+cacheSim &thread_sim();
+
+} // namespace memsim
+
+#endif // MEMSIM_H
@@ -0,0 +1,110 @@
+#!/bin/bash
+# Regression checks for the memory simulator, run from anywhere with: bash run_checks.sh
+# Builds the simulator into a temporary directory and runs the traces kept next to it.
+# Prints one line per check and exits non-zero if any check fails.
+
+repo=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+sim="$work/ece586_lab7"
+num_failed=0
+
+# Record the result of one check: its name, then the command that must succeed
+check(){
+    local name=$1
+    shift
+    if "$@" > /dev/null 2>&1; then
+        echo "ok      $name"
+    else
+        echo "FAILED  $name"
+        num_failed=$((num_failed + 1))
+    fi
+}
+
+# Whether a command's output contains a line
+output_has(){
+    local line=$1
+    shift
+    "$@" 2>&1 | grep -qF -- "$line"
+}
+
+${CXX:-g++} -std=c++17 -O2 -Wall -pthread -o "$sim" "$repo/ece586_lab7.cpp" || exit 1
+
+# test2.txt: addresses at and above 2^63 with a full 2^64 - 1 byte main memory
+# (4 hits in a 16 KB, 64 B line, 4-way cache whatever the trace encoding)
+max_mem=18446744073709551615
+check "test2 converts to the fixed encoding" "$sim" --convert "$repo/test2.txt" "$work/test2.fixed.bin" fixed
+check "test2 converts to the delta encoding" "$sim" --convert "$repo/test2.txt" "$work/test2.delta.bin" delta
+for trace in "$repo/test2.txt" "$work/test2.fixed.bin" "$work/test2.delta.bin"; do
+    check "test2 simulates from $(basename "$trace")" output_has "Actual hit rate = 4/8" \
+        "$sim" --simulate --trace "$trace" --config 16384:64:4:L --mem $max_mem --ops-out "$work/$(basename "$trace").csv"
+done
+check "test2 per-operation results match for the fixed encoding" cmp "$work/test2.txt.csv" "$work/test2.fixed.bin.csv"
+check "test2 per-operation results match for the delta encoding" cmp "$work/test2.txt.csv" "$work/test2.delta.bin.csv"
+check "test2 sweeps" output_has "        4              4     50.00%" \
+    "$sim" --sweep --trace "$repo/test2.txt" --cache 16384 --line 64 --assoc 4 --policy L --mem $max_mem
+check "test2 interactive run addresses 64 bits" output_has "Total address lines required = 64" \
+    "$sim" <<< "$max_mem 16384 64 4 L $repo/test2.txt n"
+check "test2 interactive run hits" output_has "Actual hit rate = 4/8" \
+    "$sim" <<< "$max_mem 16384 64 4 L $repo/test2.txt n"
+check "interactive run refuses a 2^64 byte main memory" output_has "---Invalid memory or cache size" \
+    "$sim" <<< "18446744073709551616 16384 64 4 L $repo/test2.txt"
+
+# test3.txt: a write to a conflicting block between two reads of the same block, then random
+# references. OPT is simulated with the same write policies as the cache, so it never hits less
+opt_not_worse(){
+    local output actual optimal
+    output=$("$sim" --compare-opt --write "$1" --allocate "$2" <<< "4096 $3 $4 $5 $6 $repo/test3.txt n") || return 1
+    actual=$(sed -n 's/^Actual hit rate = \([0-9]*\)\/.*/\1/p' <<< "$output")
+    optimal=$(sed -n 's/^Optimal (OPT) hit rate for this cache = \([0-9]*\)\/.*/\1/p' <<< "$output")
+    [ -n "$actual" ] && [ -n "$optimal" ] && [ "$optimal" -ge "$actual" ]
+}
+for write in back through; do
+    for allocate in yes no; do
+        for geometry in "128 32 1" "256 32 2" "128 32 4"; do
+            for policy in L F; do
+                check "test3 OPT hits at least $policy, write-$write, allocate $allocate, cache:line:assoc ${geometry// /:}" \
+                    opt_not_worse $write $allocate $geometry $policy
+            done
+        done
+    done
+done
+
+# test4.txt: two cores sharing, upgrading and stealing one block. Only the two write and
+# read misses to a dirty copy move data between caches, an upgrade of an Owned copy does not
+for protocol in mesi moesi; do
+    check "test4 $protocol cache-to-cache transfers" output_has "Cache-to-cache transfers = 2," \
+        "$sim" --coherence --cache 4096:64:4:L --core-trace "$repo/test4.txt" --protocol $protocol
+done
+
+# Library build: two translation units include memsim.h and link against the library
+cat > "$work/lib_a.cpp" <<'END'
+#include "memsim.h"
+long long run_reads(){
+    memsim::cacheSim sim;
+    uint64_t addresses[] = {0, 64, 0, 64};
+    sim.configure(1ULL << 32, 1024, 64, 2, 'L');
+    return sim.access_many(addresses, nullptr, 4);
+}
+END
+cat > "$work/lib_b.cpp" <<'END'
+#include "memsim.h"
+long long run_reads();
+int main(){
+    memsim::cacheSim &sim = memsim::thread_sim();
+    bool first_hit = !sim.configure(1ULL << 32, 1024, 64, 2, 'U') || sim.access(128, true);
+    bool second_hit = sim.access(128, false);
+    return (run_reads() == 2 && !first_hit && second_hit && sim.traffic().num_fills == 1) ? 0 : 1;
+}
+END
+check "library links into two translation units" bash -c "
+    ${CXX:-g++} -std=c++17 -O2 -pthread -DMEMSIM_LIBRARY -c '$repo/ece586_lab7.cpp' -o '$work/memsim.o' &&
+    ar rcs '$work/libmemsim.a' '$work/memsim.o' &&
+    ${CXX:-g++} -std=c++17 -O2 -pthread -I'$repo' '$work/lib_a.cpp' '$work/lib_b.cpp' -L'$work' -lmemsim -o '$work/lib_test' &&
+    '$work/lib_test'"
+
+if [ $num_failed -ne 0 ]; then
+    echo "$num_failed check(s) failed"
+    exit 1
+fi
+echo "All checks passed"